@@ -0,0 +1,215 @@
+#!/usr/bin/python3
+# adpcm_ref - reference mixer and encoder for xbase/adpcm.
+#
+# usage:
+#   adpcm_ref.py encode in.raw out.pcm
+#   adpcm_ref.py mix out.pcm blocks in.raw[:pitch[:volume[:loop]]] ...
+#   adpcm_ref.py decode in.pcm out.raw
+#
+# Inputs are signed 16-bit big-endian PCM, as xbase plays them. The mix and
+# encode follow adpcm_mix.a68 step for step, so their output can be compared
+# byte for byte with the DMA blocks dumped from a running program (the first
+# blocks after xb_adpcm_init(), with the same voices started before it), or
+# with adpcmsim, the host build of the mixer, which takes the same arguments
+# (make check runs both on a few test samples). adpcmsim runs a C copy of the
+# assembly, not adpcm_mix.a68 itself, so only a dump from a running program
+# checks the assembly. decode turns ADPCM back into 16-bit PCM to listen to.
+#
+# mike moffitt
+import struct
+import sys
+
+BLOCK_SAMPLES = 512
+VOLUME_MAX = 64
+
+STEP_TABLE = [
+	16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+	73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253,
+	279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+	963, 1060, 1166, 1282, 1411, 1552,
+]
+INDEX_ADJUST = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def s16(v):
+	v &= 0xFFFF
+	return v - 0x10000 if v & 0x8000 else v
+
+
+def clamp(v, lo, hi):
+	return lo if v < lo else hi if v > hi else v
+
+
+def read_pcm(path):
+	with open(path, "rb") as f:
+		data = f.read()
+	return list(struct.unpack(">%dh" % (len(data) // 2), data[:len(data) & ~1]))
+
+
+class Encoder:
+	def __init__(self):
+		self.predictor = 0
+		self.index = 0
+
+	def sample(self, s):
+		diff = clamp(s, -2048, 2047) - self.predictor
+		code = 0
+		if diff < 0:
+			code = 8
+			diff = -diff
+		step = STEP_TABLE[self.index]
+		delta = step >> 3
+		if diff >= step:
+			code |= 4
+			diff -= step
+			delta += step
+		step >>= 1
+		if diff >= step:
+			code |= 2
+			diff -= step
+			delta += step
+		step >>= 1
+		if diff >= step:
+			code |= 1
+			delta += step
+		if code & 8:
+			delta = -delta
+		self.predictor = clamp(self.predictor + delta, -2048, 2047)
+		self.index = clamp(self.index + INDEX_ADJUST[code & 7], 0,
+		                   len(STEP_TABLE) - 1)
+		return code
+
+	def encode(self, samples):
+		out = bytearray()
+		for i in range(0, len(samples) & ~1, 2):
+			lo = self.sample(samples[i])
+			out.append(lo | (self.sample(samples[i + 1]) << 4))
+		return out
+
+
+def decode(data):
+	predictor = 0
+	index = 0
+	out = []
+	for b in data:
+		for code in (b & 0x0F, b >> 4):
+			step = STEP_TABLE[index]
+			delta = step >> 3
+			if code & 4: delta += step
+			if code & 2: delta += step >> 1
+			if code & 1: delta += step >> 2
+			if code & 8: delta = -delta
+			predictor = clamp(predictor + delta, -2048, 2047)
+			index = clamp(index + INDEX_ADJUST[code & 7], 0, len(STEP_TABLE) - 1)
+			out.append(predictor << 4)
+	return out
+
+
+class Voice:
+	def __init__(self, pcm, pitch, volume, loop):
+		self.pcm = pcm
+		self.pos = 0
+		self.frac = 0
+		self.pitch = pitch
+		self.volume = volume
+		self.loop = loop if loop is not None and 0 <= loop < len(pcm) else None
+
+	def wrap(self):
+		if self.loop is None:
+			self.pos = None
+			return
+		loop_len = len(self.pcm) - self.loop
+		self.pos = self.loop + (self.pos - len(self.pcm)) % loop_len
+
+	# Same as xb_adpcm_mix_span().
+	def span(self, mix, at, count, first):
+		for i in range(at, at + count):
+			s = self.pcm[self.pos]
+			if self.volume >= VOLUME_MAX:
+				s >>= 4
+			else:
+				s = s16((s * self.volume) >> 8) >> 2
+			mix[i] = s16(s if first else mix[i] + s)
+			self.frac += (self.pitch & 0xFF) << 8
+			if self.frac > 0xFFFF:
+				self.frac &= 0xFFFF
+				self.pos += 1
+			self.pos += self.pitch >> 8
+
+	# Same as mix_voice() in adpcm.c.
+	def mix(self, mix, first):
+		at = 0
+		left = BLOCK_SAMPLES
+		while left > 0:
+			count = left
+			rem = (len(self.pcm) - self.pos) << 8
+			frac = self.frac >> 8
+			if self.pitch and frac + (left - 1) * self.pitch >= rem:
+				count = (rem - frac + self.pitch - 1) // self.pitch
+			if count > 0:
+				self.span(mix, at, count, first)
+				at += count
+				left -= count
+			if left == 0:
+				break
+			self.wrap()
+			if self.pos is None:
+				if first:
+					for i in range(at, BLOCK_SAMPLES):
+						mix[i] = 0
+				return
+		if self.pos >= len(self.pcm):
+			self.wrap()
+
+
+def parse_voice(arg):
+	parts = arg.split(":")
+	pcm = read_pcm(parts[0])
+	pitch = int(parts[1], 0) if len(parts) > 1 else 0x100
+	volume = int(parts[2], 0) if len(parts) > 2 else VOLUME_MAX
+	loop = int(parts[3], 0) if len(parts) > 3 else None
+	return Voice(pcm, pitch, volume, loop)
+
+
+def mix_blocks(voices, blocks):
+	enc = Encoder()
+	out = bytearray()
+	for _ in range(blocks):
+		mix = [0] * BLOCK_SAMPLES
+		mixed = 0
+		for v in voices:
+			if v.pos is None:
+				continue
+			v.mix(mix, mixed == 0)
+			mixed += 1
+		if mixed == 0 and enc.predictor == 0 and enc.index == 0:
+			out += bytes([0x80] * (BLOCK_SAMPLES // 2))
+			continue
+		out += enc.encode(mix)
+	return out
+
+
+def main(argv):
+	if len(argv) == 4 and argv[1] == "encode":
+		data = Encoder().encode([s >> 4 for s in read_pcm(argv[2])])
+	elif len(argv) == 4 and argv[1] == "decode":
+		with open(argv[2], "rb") as f:
+			pcm = decode(f.read())
+		data = struct.pack(">%dh" % len(pcm), *pcm)
+	elif len(argv) >= 5 and argv[1] == "mix":
+		data = mix_blocks([parse_voice(a) for a in argv[4:]], int(argv[3], 0))
+	else:
+		print("usage: %s encode in.raw out.pcm" % argv[0])
+		print("       %s mix out.pcm blocks in.raw[:pitch[:volume[:loop]]] ..."
+		      % argv[0])
+		print("       %s decode in.pcm out.raw" % argv[0])
+		return 1
+	out_path = argv[3] if argv[1] != "mix" else argv[2]
+	with open(out_path, "wb") as f:
+		f.write(data)
+	print("%s: %d bytes" % (out_path, len(data)))
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
@@ -0,0 +1,262 @@
+// adpcmsim - runs the xbase ADPCM mixer on the host, for checking against
+// adpcm_ref.py.
+//
+// usage:
+//   adpcmsim encode in.raw out.pcm
+//   adpcmsim mix out.pcm blocks in.raw[:pitch[:volume[:loop]]] ...
+//
+// The arguments and output are those of adpcm_ref.py, so the two can be
+// compared byte for byte (make check does this on a few generated samples).
+// The voices are played with xb_adpcm_play() and mixed a block at a time by
+// adpcm.c, built with XB_ADPCM_HOST_SIM; xb_adpcm_mix_span() and
+// xb_adpcm_encode() here are C transliterations of adpcm_mix.a68, including
+// its 16-bit arithmetic. The assembly itself is not run, so the check covers
+// adpcm.c's block handling and the mixing algorithm, not adpcm_mix.a68; a
+// mistake made only in the assembly is not caught.
+#include "xbase/adpcm.h"
+#include "xbase/ipl.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENCODE_CHUNK 0x8000  // Samples per xb_adpcm_encode() call; even.
+
+static const int16_t s_step_table[] =
+{
+	16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+	73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253,
+	279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+	963, 1060, 1166, 1282, 1411, 1552,
+};
+#define STEP_MAX 48
+
+static const int16_t s_index_adjust[] =
+{
+	-1 * 2, -1 * 2, -1 * 2, -1 * 2, 2 * 2, 4 * 2, 6 * 2, 8 * 2,
+};
+
+//
+// adpcm_mix.a68
+//
+
+void xb_adpcm_mix_span(int16_t *dst, uint16_t count, XBAdpcmVoice *v,
+                       bool first)
+{
+	if (count == 0) return;
+	const int16_t *src = v->pos;
+	uint16_t frac = v->frac;
+	const uint16_t frac_step = (uint16_t)(v->pitch << 8);
+	const uint16_t whole_step = v->pitch >> 8;
+	const bool full = v->volume >= XB_ADPCM_VOLUME_MAX;
+	while (count--)
+	{
+		int16_t s = *src;
+		if (full)
+		{
+			s = s >> 4;
+		}
+		else
+		{
+			// muls.w, asr.l #8, then asr.w #2 on the low word.
+			s = (int16_t)(((int32_t)s * (int16_t)v->volume) >> 8) >> 2;
+		}
+		*dst = first ? s : (int16_t)(*dst + s);
+		dst++;
+		const uint32_t sum = (uint32_t)frac + frac_step;
+		frac = (uint16_t)sum;
+		if (sum > 0xFFFF) src++;
+		src += whole_step;
+	}
+	v->pos = src;
+	v->frac = frac;
+}
+
+static int16_t clip12(int16_t s)
+{
+	if (s > 2047) return 2047;
+	if (s < -2048) return -2048;
+	return s;
+}
+
+// One ENCODE. index is the step index times two, as in the assembly.
+static uint8_t encode_sample(int16_t in, int16_t *predictor, int16_t *index)
+{
+	int16_t diff = (int16_t)(clip12(in) - *predictor);
+	uint8_t code = 0;
+	if (diff < 0)
+	{
+		code = 8;
+		diff = -diff;
+	}
+	int16_t step = s_step_table[*index / 2];
+	int16_t delta = (uint16_t)step >> 3;
+	if (diff >= step)
+	{
+		code += 4;
+		diff -= step;
+		delta += step;
+	}
+	step = (uint16_t)step >> 1;
+	if (diff >= step)
+	{
+		code += 2;
+		diff -= step;
+		delta += step;
+	}
+	step = (uint16_t)step >> 1;
+	if (diff >= step)
+	{
+		code += 1;
+		delta += step;
+	}
+	if (code & 8) delta = -delta;
+	*predictor = clip12((int16_t)(*predictor + delta));
+	*index += s_index_adjust[code & 7];
+	if (*index < 0) *index = 0;
+	if (*index > STEP_MAX * 2) *index = STEP_MAX * 2;
+	return code;
+}
+
+void xb_adpcm_encode(const int16_t *src, uint8_t *dst, uint16_t count,
+                     XBAdpcmEncoder *enc)
+{
+	int16_t predictor = enc->predictor;
+	int16_t index = enc->index;
+	for (count >>= 1; count > 0; count--)
+	{
+		const uint8_t lo = encode_sample(*src++, &predictor, &index);
+		const uint8_t hi = encode_sample(*src++, &predictor, &index);
+		*dst++ = lo | (hi << 4);
+	}
+	enc->predictor = predictor;
+	enc->index = index;
+}
+
+//
+// Stubs
+//
+
+uint8_t xb_set_ipl(uint8_t ipl)
+{
+	(void)ipl;
+	return XB_IPL_ALLOW_ALL;
+}
+
+//
+// Main
+//
+
+// Reads big-endian 16-bit PCM. Returns NULL on failure.
+static int16_t *read_pcm(const char *path, uint32_t *samples)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+	{
+		perror(path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	const long bytes = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *raw = malloc(bytes + 1);
+	int16_t *pcm = malloc((bytes / 2 + 1) * sizeof(*pcm));
+	if (!raw || !pcm || fread(raw, 1, bytes, f) != (size_t)bytes)
+	{
+		fprintf(stderr, "%s: read failed\n", path);
+		fclose(f);
+		free(raw);
+		free(pcm);
+		return NULL;
+	}
+	fclose(f);
+	*samples = bytes / 2;
+	for (uint32_t i = 0; i < *samples; i++)
+	{
+		pcm[i] = (int16_t)((raw[i * 2] << 8) | raw[i * 2 + 1]);
+	}
+	free(raw);
+	return pcm;
+}
+
+static int write_out(const char *path, const uint8_t *data, size_t len)
+{
+	FILE *f = fopen(path, "wb");
+	if (!f || fwrite(data, 1, len, f) != len)
+	{
+		perror(path);
+		if (f) fclose(f);
+		return 1;
+	}
+	fclose(f);
+	printf("%s: %zu bytes\n", path, len);
+	return 0;
+}
+
+static int encode(const char *in_path, const char *out_path)
+{
+	uint32_t samples;
+	int16_t *pcm = read_pcm(in_path, &samples);
+	if (!pcm) return 1;
+	samples &= ~1;
+	for (uint32_t i = 0; i < samples; i++) pcm[i] >>= 4;
+	uint8_t *out = malloc(samples / 2 + 1);
+	XBAdpcmEncoder enc = {0, 0};
+	for (uint32_t i = 0; i < samples; i += ENCODE_CHUNK)
+	{
+		const uint32_t count = (samples - i < ENCODE_CHUNK) ? samples - i
+		                                                    : ENCODE_CHUNK;
+		xb_adpcm_encode(&pcm[i], &out[i / 2], count, &enc);
+	}
+	const int ret = write_out(out_path, out, samples / 2);
+	free(out);
+	free(pcm);
+	return ret;
+}
+
+static int mix(const char *out_path, uint32_t blocks, int argc, char **argv)
+{
+	if (argc > XB_ADPCM_VOICES)
+	{
+		fprintf(stderr, "at most %d voices\n", XB_ADPCM_VOICES);
+		return 1;
+	}
+	for (int i = 0; i < argc; i++)
+	{
+		char *path = strtok(argv[i], ":");
+		const char *pitch = strtok(NULL, ":");
+		const char *volume = strtok(NULL, ":");
+		const char *loop = strtok(NULL, ":");
+		uint32_t samples;
+		const int16_t *pcm = read_pcm(path, &samples);
+		if (!pcm) return 1;
+		xb_adpcm_play(-1, pcm, samples, loop ? strtol(loop, NULL, 0) : -1,
+		              pitch ? strtol(pitch, NULL, 0) : XB_ADPCM_PITCH_1X,
+		              volume ? strtol(volume, NULL, 0) : XB_ADPCM_VOLUME_MAX);
+	}
+	uint8_t *out = malloc((size_t)blocks * XB_ADPCM_BLOCK_BYTES + 1);
+	for (uint32_t i = 0; i < blocks; i++)
+	{
+		xb_adpcm_sim_mix_block(&out[i * XB_ADPCM_BLOCK_BYTES]);
+	}
+	const int ret = write_out(out_path, out,
+	                          (size_t)blocks * XB_ADPCM_BLOCK_BYTES);
+	free(out);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 4 && !strcmp(argv[1], "encode")) return encode(argv[2], argv[3]);
+	if (argc >= 5 && !strcmp(argv[1], "mix"))
+	{
+		return mix(argv[2], strtoul(argv[3], NULL, 0), argc - 4, argv + 4);
+	}
+	fprintf(stderr,
+	        "usage: %s encode in.raw out.pcm\n"
+	        "       %s mix out.pcm blocks in.raw[:pitch[:volume[:loop]]] ...\n",
+	        argv[0], argv[0]);
+	return 1;
+}
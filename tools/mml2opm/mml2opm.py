@@ -0,0 +1,478 @@
+#!/usr/bin/python3
+# mml2opm - compiles MML text into song data for xbase/util/opmseq.
+#
+# usage: mml2opm.py input.mml output.bin [--c symbol_name]
+#
+# With --c, a C source file with the song as a const uint8_t array is written
+# instead of a binary.
+#
+# Input format
+# ------------
+#
+# ; comment to end of line
+#
+# #tpq 48         ticks per quarter note (default 48)
+# #tempo 120      starting tempo in BPM (default 120)
+#
+# Instruments, MXDRV style. Four operator rows, in M1, C1, M2, C2 order, then
+# the connection row:
+#
+# @0 = {
+#  AR D1R D2R RR D1L  TL KS MUL DT1 DT2 AME
+#  31  18   0 15   2  36  0   1   3   0   0
+#  ...three more operator rows...
+#  CON FL OPMASK
+#   4   7  15
+# }
+#
+# Macros. One value is used per tick from the start of a note. A | marks the
+# loop point; without one, the last value is held.
+#
+# @v0 = { 0 1 2 4 8 | 8 12 }   volume (added to carrier TL; larger is quieter)
+# @p0 = { 0 0 8 | 16 0 -16 0 } pitch (1/64 semitone units)
+#
+# Tracks. A line starting with a channel letter A-H adds to that channel:
+#
+# A t120 @0 v12 o4 l8 cdefg4 r4 [ceg]2 L c1 & c1
+#
+#   c d e f g a b    notes, with + or # (sharp) or - (flat), then a length
+#   r                rest
+#   length           4 = quarter note, 8 = eighth, etc. Dots extend by half.
+#                    %n gives a length in ticks.
+#   l n              default length
+#   o n, < >         octave (0 - 7), octave down / up
+#   &                tie into the next note (no key on)
+#   @n               instrument
+#   v n              volume (0 - 15)
+#   V n              attenuation (0 - 127)
+#   p n              pan (0 = off, 1 = left, 2 = right, 3 = both)
+#   q n              gate time in 8ths of the note length (1 - 8)
+#   D n              detune in 1/64 semitones (-128 - 127)
+#   t n              tempo in BPM
+#   @v n, @p n       volume / pitch macro; with no number, turns it off
+#   [ ... ] n        repeat n times (default 2)
+#   L                loop point for the channel; the end jumps back to it
+#
+# mike moffitt
+import sys
+import re
+
+# Bytecode, matching xbase/util/opmseq.h.
+CMD_REST = 0x60
+CMD_TIE = 0x61
+CMD_END = 0x80
+CMD_JUMP = 0x81
+CMD_LOOP_START = 0x82
+CMD_LOOP_END = 0x83
+CMD_INST = 0x84
+CMD_VOLUME = 0x85
+CMD_PAN = 0x86
+CMD_VOL_MACRO = 0x87
+CMD_PITCH_MACRO = 0x88
+CMD_DETUNE = 0x89
+CMD_TEMPO = 0x8A
+CMD_GATE = 0x8B
+
+NOTE_MAX = 0x5F
+MACRO_NONE = 0xFF
+INST_BYTES = 26
+HEADER_BYTES = 0x1A
+CHANNELS = "ABCDEFGH"
+
+OPM_CLOCK = 4000000
+
+NOTE_SEMITONES = {"c": 0, "d": 2, "e": 4, "f": 5, "g": 7, "a": 9, "b": 11}
+PAN_VALUES = [0x00, 0x40, 0x80, 0xC0]
+
+# Operator rows are written M1, C1, M2, C2; the registers go M1, M2, C1, C2.
+OP_TEXT_TO_SLOT = [0, 2, 1, 3]
+
+
+class MmlError(Exception):
+	pass
+
+
+def timer_b_period(bpm, tpq):
+	tick_seconds = 60.0 / (bpm * tpq)
+	period = int(round(256 - (tick_seconds * OPM_CLOCK / 1024)))
+	return max(0, min(255, period))
+
+
+def volume_to_attenuation(v):
+	return (15 - max(0, min(15, v))) * 3
+
+
+class Track:
+	def __init__(self, song):
+		self.song = song
+		self.data = bytearray()
+		self.fixups = []  # positions of 16-bit offsets relative to the track
+		self.loop_point = None
+		self.loop_stack = []
+		self.octave = 4
+		self.length = song.tpq
+		self.tie_next = False
+		self.max_loop_depth = 0
+
+	def emit(self, *vals):
+		for v in vals:
+			self.data.append(v & 0xFF)
+
+	def emit_split(self, first_cmd, ticks, rest_cmd):
+		# Lengths are one byte; longer ones continue with ties or rests.
+		while ticks > 0:
+			chunk = min(ticks, 255)
+			self.emit(first_cmd, chunk)
+			first_cmd = rest_cmd
+			ticks -= chunk
+
+	def finish(self):
+		if self.loop_stack:
+			raise MmlError("unclosed [")
+		if self.loop_point is not None:
+			self.emit(CMD_JUMP)
+			self.fixups.append(len(self.data))
+			self.emit(self.loop_point >> 8, self.loop_point)
+		else:
+			self.emit(CMD_END)
+
+
+class Song:
+	def __init__(self):
+		self.tpq = 48
+		self.tempo = 120
+		self.instruments = {}
+		self.vol_macros = {}
+		self.pitch_macros = {}
+		self.tracks = {}
+
+	def track(self, ch):
+		if ch not in self.tracks:
+			self.tracks[ch] = Track(self)
+		return self.tracks[ch]
+
+
+#
+# Parsing
+#
+
+def parse_int_list(text):
+	return [int(v) for v in re.findall(r"-?\d+", text)]
+
+
+def parse_instrument(num, text):
+	vals = parse_int_list(text)
+	if len(vals) != 47:
+		raise MmlError("@%d: expected 47 values, got %d" % (num, len(vals)))
+	ops = [vals[i * 11:(i + 1) * 11] for i in range(4)]
+	con, fl = vals[44], vals[45]
+	slots = [None] * 4
+	for text_idx, op in enumerate(ops):
+		slots[OP_TEXT_TO_SLOT[text_idx]] = op
+
+	out = bytearray([((fl & 7) << 3) | (con & 7), 0])
+	# DT1/MUL, TL, KS/AR, AME/D1R, DT2/D2R, D1L/RR
+	encoders = [
+		lambda o: ((o[8] & 7) << 4) | (o[7] & 15),
+		lambda o: o[5] & 127,
+		lambda o: ((o[6] & 3) << 6) | (o[0] & 31),
+		lambda o: ((1 if o[10] else 0) << 7) | (o[1] & 31),
+		lambda o: ((o[9] & 3) << 6) | (o[2] & 31),
+		lambda o: ((o[4] & 15) << 4) | (o[3] & 15),
+	]
+	for enc in encoders:
+		for op in slots:
+			out.append(enc(op))
+	assert len(out) == INST_BYTES
+	return bytes(out)
+
+
+def parse_macro(name, text):
+	parts = text.split("|")
+	if len(parts) > 2:
+		raise MmlError("%s: more than one loop point" % name)
+	head = parse_int_list(parts[0])
+	tail = parse_int_list(parts[1]) if len(parts) > 1 else []
+	if len(parts) > 1 and not tail:
+		raise MmlError("%s: no values after the loop point" % name)
+	vals = head + tail
+	if not vals or len(vals) > 255:
+		raise MmlError("%s: needs 1 - 255 values" % name)
+	for v in vals:
+		if v < -128 or v > 127:
+			raise MmlError("%s: value %d out of range" % (name, v))
+	loop = len(head) if len(parts) > 1 else MACRO_NONE
+	assert loop == MACRO_NONE or loop < len(vals)
+	return bytes([len(vals), loop] + [v & 0xFF for v in vals])
+
+
+class Reader:
+	def __init__(self, text, line_no):
+		self.text = text
+		self.pos = 0
+		self.line_no = line_no
+
+	def error(self, msg):
+		raise MmlError("line %d: %s" % (self.line_no, msg))
+
+	def peek(self):
+		self.skip_space()
+		return self.text[self.pos] if self.pos < len(self.text) else ""
+
+	def skip_space(self):
+		while self.pos < len(self.text) and self.text[self.pos] in " \t":
+			self.pos += 1
+
+	def next(self):
+		c = self.peek()
+		self.pos += 1
+		return c
+
+	def number(self, default=None):
+		self.skip_space()
+		m = re.match(r"-?\d+", self.text[self.pos:])
+		if not m:
+			if default is None:
+				self.error("expected a number")
+			return default
+		self.pos += m.end()
+		return int(m.group(0))
+
+	def at_end(self):
+		return self.peek() == ""
+
+
+def read_length(r, track):
+	tpq = track.song.tpq
+	if r.peek() == "%":
+		r.next()
+		ticks = r.number()
+	else:
+		n = r.number(0)
+		ticks = track.length if n == 0 else (tpq * 4) // n
+	add = ticks
+	while r.peek() == ".":
+		r.next()
+		add //= 2
+		ticks += add
+	if ticks <= 0:
+		r.error("zero length")
+	return ticks
+
+
+def compile_track_text(track, r):
+	song = track.song
+	while not r.at_end():
+		c = r.next()
+		if c in NOTE_SEMITONES:
+			note = track.octave * 12 + NOTE_SEMITONES[c]
+			while r.peek() in ("+", "#", "-"):
+				note += -1 if r.next() == "-" else 1
+			ticks = read_length(r, track)
+			if note < 0 or note > NOTE_MAX:
+				r.error("note out of range")
+			if track.tie_next:
+				track.emit_split(CMD_TIE, ticks, CMD_TIE)
+			else:
+				track.emit(note)
+				track.emit(min(ticks, 255))
+				track.emit_split(CMD_TIE, ticks - min(ticks, 255), CMD_TIE)
+			track.tie_next = False
+			if r.peek() == "&":
+				r.next()
+				track.tie_next = True
+		elif c == "r":
+			track.emit_split(CMD_REST, read_length(r, track), CMD_REST)
+			track.tie_next = False
+		elif c == "l":
+			track.length = read_length(r, track)
+		elif c == "o":
+			track.octave = r.number()
+		elif c == "<":
+			track.octave -= 1
+		elif c == ">":
+			track.octave += 1
+		elif c == "@":
+			if r.peek() in ("v", "p"):
+				kind = r.next()
+				n = r.number(MACRO_NONE)
+				table = song.vol_macros if kind == "v" else song.pitch_macros
+				if n != MACRO_NONE and n not in table:
+					r.error("@%s%d is not defined" % (kind, n))
+				track.emit(CMD_VOL_MACRO if kind == "v" else CMD_PITCH_MACRO, n)
+			else:
+				n = r.number()
+				if n not in song.instruments:
+					r.error("@%d is not defined" % n)
+				track.emit(CMD_INST, n)
+		elif c == "v":
+			track.emit(CMD_VOLUME, volume_to_attenuation(r.number()))
+		elif c == "V":
+			track.emit(CMD_VOLUME, max(0, min(127, r.number())))
+		elif c == "p":
+			track.emit(CMD_PAN, PAN_VALUES[r.number() & 3])
+		elif c == "q":
+			track.emit(CMD_GATE, max(1, min(8, r.number())))
+		elif c == "D":
+			track.emit(CMD_DETUNE, max(-128, min(127, r.number())))
+		elif c == "t":
+			track.emit(CMD_TEMPO, timer_b_period(r.number(), song.tpq))
+		elif c == "[":
+			track.emit(CMD_LOOP_START, 0)
+			track.loop_stack.append(len(track.data) - 1)
+			track.max_loop_depth = max(track.max_loop_depth,
+			                           len(track.loop_stack))
+			if len(track.loop_stack) > 4:
+				r.error("repeats nested too deeply")
+		elif c == "]":
+			if not track.loop_stack:
+				r.error("] without [")
+			count = r.number(2)
+			if count < 1 or count > 255:
+				r.error("repeat count out of range")
+			track.data[track.loop_stack.pop()] = count
+			track.emit(CMD_LOOP_END)
+		elif c == "L":
+			if track.loop_stack:
+				r.error("loop point inside a repeat")
+			track.loop_point = len(track.data)
+		else:
+			r.error("unexpected '%s'" % c)
+
+
+def parse(text):
+	song = Song()
+	# Definitions may span lines, so they are taken out first.
+	def_re = re.compile(r"^\s*@(v|p)?(\d+)\s*=\s*\{([^}]*)\}", re.M)
+	text = re.sub(r";[^\n]*", "", text)
+	for m in def_re.finditer(text):
+		kind, num, body = m.group(1), int(m.group(2)), m.group(3)
+		if kind == "v":
+			song.vol_macros[num] = parse_macro("@v%d" % num, body)
+		elif kind == "p":
+			song.pitch_macros[num] = parse_macro("@p%d" % num, body)
+		else:
+			song.instruments[num] = parse_instrument(num, body)
+	# Keep line numbers for errors by blanking definitions rather than removing.
+	text = def_re.sub(lambda m: "\n" * m.group(0).count("\n"), text)
+
+	for line_no, line in enumerate(text.split("\n"), 1):
+		line = line.strip()
+		if not line:
+			continue
+		if line.startswith("#"):
+			key, _, val = line[1:].partition(" ")
+			if key == "tpq":
+				song.tpq = int(val)
+			elif key == "tempo":
+				song.tempo = int(val)
+			else:
+				raise MmlError("line %d: unknown directive #%s" % (line_no, key))
+			continue
+		channels = ""
+		while line and line[0] in CHANNELS:
+			channels += line[0]
+			line = line[1:]
+		if not channels:
+			raise MmlError("line %d: expected channel letters" % line_no)
+		for ch in channels:
+			compile_track_text(song.track(ch), Reader(line, line_no))
+	for t in song.tracks.values():
+		t.finish()
+	return song
+
+
+#
+# Output
+#
+
+def macro_table(macros):
+	count = (max(macros) + 1) if macros else 0
+	return count, [macros.get(i, bytes([0, MACRO_NONE])) for i in range(count)]
+
+
+def build(song):
+	out = bytearray(HEADER_BYTES)
+	out[0:2] = b"OS"
+	out[2] = timer_b_period(song.tempo, song.tpq)
+	out[3] = min(song.tpq, 255)
+
+	def put16(pos, val):
+		if val > 0xFFFF:
+			raise MmlError("song is larger than 64KiB")
+		out[pos] = val >> 8
+		out[pos + 1] = val & 0xFF
+
+	# Instruments, indexed directly by number.
+	put16(0x14, len(out))
+	inst_count = (max(song.instruments) + 1) if song.instruments else 0
+	for i in range(inst_count):
+		out += song.instruments.get(i, bytes(INST_BYTES))
+
+	for header_pos, macros in ((0x16, song.vol_macros),
+	                           (0x18, song.pitch_macros)):
+		count, data = macro_table(macros)
+		table = len(out)
+		put16(header_pos, table)
+		out += bytes(count * 2)
+		for i, m in enumerate(data):
+			put16(table + i * 2, len(out))
+			out += m
+
+	for i, ch in enumerate(CHANNELS):
+		t = song.tracks.get(ch)
+		if not t:
+			continue
+		base = len(out)
+		put16(0x04 + i * 2, base)
+		data = bytearray(t.data)
+		for f in t.fixups:
+			target = base + ((data[f] << 8) | data[f + 1])
+			data[f] = target >> 8
+			data[f + 1] = target & 0xFF
+		out += data
+	return bytes(out)
+
+
+def write_c(path, symbol, data):
+	with open(path, "w") as f:
+		f.write("// Generated by mml2opm.py\n")
+		f.write("#include <stdint.h>\n\n")
+		f.write("const uint8_t %s[%d] =\n{\n" % (symbol, len(data)))
+		for i in range(0, len(data), 16):
+			row = ", ".join("0x%02X" % b for b in data[i:i + 16])
+			f.write("\t%s,\n" % row)
+		f.write("};\n")
+
+
+def main(argv):
+	if len(argv) not in (3, 5) or (len(argv) == 5 and argv[3] != "--c"):
+		print("usage: %s input.mml output [--c symbol_name]" % argv[0])
+		return 1
+	with open(argv[1], "r") as f:
+		text = f.read()
+	try:
+		song = parse(text)
+		data = build(song)
+	except MmlError as e:
+		print("%s: %s" % (argv[1], e), file=sys.stderr)
+		return 1
+
+	if len(argv) == 5:
+		write_c(argv[2], argv[4], data)
+	else:
+		with open(argv[2], "wb") as f:
+			f.write(data)
+
+	print("%s: %d bytes, %d instruments, Timer B %d" %
+	      (argv[2], len(data), len(song.instruments), data[2]))
+	for ch in CHANNELS:
+		t = song.tracks.get(ch)
+		if t:
+			print("  %s: %d bytes, repeat depth %d" %
+			      (ch, len(t.data), t.max_loop_depth))
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
@@ -0,0 +1,185 @@
+#!/usr/bin/python3
+# opmbank - builds an OPM patch bank (see XBOpmPatch in xbase/opm.h) from
+# instrument definitions.
+#
+# usage: opmbank.py output.bin input [input ...] [--c symbol_name]
+#
+# Inputs may be:
+#  - VOPM .opm files (@:n Name, LFO:, CH:, M1:, C1:, M2:, C2: lines)
+#  - MML files with MXDRV style @n = { ... } definitions, as read by mml2opm
+#
+# Patches are numbered in the order they are read, regardless of the numbers
+# in the source files. With --c, a C file with the bank as an array is written,
+# and next to it a header (the same name, ending in .h) declaring the array,
+# with #defines for the patch numbers by name.
+#
+# mike moffitt
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "mml2opm"))
+import mml2opm
+
+PATCH_BYTES = 26
+
+# VOPM operator lines are M1, C1, M2, C2; the registers go M1, M2, C1, C2.
+VOPM_SLOTS = {"M1": 0, "M2": 1, "C1": 2, "C2": 3}
+
+
+class BankError(Exception):
+	pass
+
+
+def encode_patch(fl, con, pms, ams, ops):
+	# ops: four (ar, d1r, d2r, rr, d1l, tl, ks, mul, dt1, dt2, ame), in slot
+	# order.
+	out = bytearray([((fl & 7) << 3) | (con & 7), ((pms & 7) << 4) | (ams & 3)])
+	for enc in (
+		lambda o: ((o[8] & 7) << 4) | (o[7] & 15),
+		lambda o: o[5] & 127,
+		lambda o: ((o[6] & 3) << 6) | (o[0] & 31),
+		lambda o: ((1 if o[10] else 0) << 7) | (o[1] & 31),
+		lambda o: ((o[9] & 3) << 6) | (o[2] & 31),
+		lambda o: ((o[4] & 15) << 4) | (o[3] & 15),
+	):
+		for op in ops:
+			out.append(enc(op))
+	assert len(out) == PATCH_BYTES
+	return bytes(out)
+
+
+def read_vopm(path, text):
+	patches = []
+	cur = None
+
+	def finish():
+		if cur is None:
+			return
+		if "CH" not in cur or any(s not in cur for s in VOPM_SLOTS):
+			raise BankError("%s: patch '%s' is incomplete" % (path, cur["name"]))
+		ch = cur["CH"]
+		if len(ch) < 5:
+			raise BankError("%s: bad CH: line in '%s'" % (path, cur["name"]))
+		ops = [None] * 4
+		for s, idx in VOPM_SLOTS.items():
+			if len(cur[s]) < 11:
+				raise BankError("%s: bad %s: line in '%s'" %
+				                (path, s, cur["name"]))
+			ops[idx] = cur[s][:11]
+		# CH: PAN FL CON AMS PMS SLOT NE
+		patches.append((cur["name"],
+		                encode_patch(ch[1], ch[2], ch[4], ch[3], ops)))
+
+	for line in text.split("\n"):
+		line = line.split("//")[0].strip()
+		if not line:
+			continue
+		m = re.match(r"@:\s*(\d+)\s*(.*)", line)
+		if m:
+			finish()
+			cur = {"name": m.group(2).strip() or "patch%s" % m.group(1)}
+			continue
+		m = re.match(r"(LFO|CH|M1|C1|M2|C2):(.*)", line)
+		if m and cur is not None:
+			cur[m.group(1)] = [int(v) for v in re.findall(r"-?\d+", m.group(2))]
+	finish()
+	return patches
+
+
+def read_mml(path, text):
+	text = re.sub(r";[^\n]*", "", text)
+	patches = []
+	for m in re.finditer(r"^\s*@(\d+)\s*=\s*\{([^}]*)\}", text, re.M):
+		num = int(m.group(1))
+		try:
+			data = mml2opm.parse_instrument(num, m.group(2))
+		except mml2opm.MmlError as e:
+			raise BankError("%s: %s" % (path, e))
+		patches.append(("patch%d" % num, data))
+	return patches
+
+
+def read_patches(path):
+	with open(path, "r", errors="replace") as f:
+		text = f.read()
+	if re.search(r"^\s*@:", text, re.M):
+		return read_vopm(path, text)
+	return read_mml(path, text)
+
+
+def c_name(name):
+	name = re.sub(r"[^A-Za-z0-9]+", "_", name).strip("_").upper()
+	return name or "UNNAMED"
+
+
+def main(argv):
+	args = argv[1:]
+	symbol = None
+	if "--c" in args:
+		i = args.index("--c")
+		symbol = args[i + 1]
+		del args[i:i + 2]
+	if len(args) < 2:
+		print("usage: %s output input [input ...] [--c symbol_name]" % argv[0])
+		return 1
+
+	patches = []
+	try:
+		for path in args[1:]:
+			patches += read_patches(path)
+	except BankError as e:
+		print(e, file=sys.stderr)
+		return 1
+	if not patches:
+		print("no patches found", file=sys.stderr)
+		return 1
+	if len(patches) > 0xFFFF:
+		print("%d patches found; a bank holds at most 65535" % len(patches),
+		      file=sys.stderr)
+		return 1
+
+	data = bytearray(b"OB")
+	data += bytes([len(patches) >> 8, len(patches) & 0xFF])
+	for _, p in patches:
+		data += p
+
+	if symbol:
+		header = os.path.splitext(args[0])[0] + ".h"
+		if header == args[0]:
+			print("%s: the C output needs a name not ending in .h" % args[0],
+			      file=sys.stderr)
+			return 1
+		with open(header, "w") as f:
+			f.write("// Generated by opmbank.py\n")
+			f.write("#pragma once\n")
+			f.write("#include <stdint.h>\n\n")
+			used = set()
+			for i, (name, _) in enumerate(patches):
+				define = "%s_%s" % (symbol.upper(), c_name(name))
+				while define in used:
+					define += "_"
+				used.add(define)
+				f.write("#define %s %d\n" % (define, i))
+			f.write("\nextern const uint8_t %s[%d];\n" % (symbol, len(data)))
+		with open(args[0], "w") as f:
+			f.write("// Generated by opmbank.py\n")
+			f.write("#include \"%s\"\n" % os.path.basename(header))
+			f.write("\nconst uint8_t %s[%d] =\n{\n" % (symbol, len(data)))
+			for i in range(0, len(data), 16):
+				row = ", ".join("0x%02X" % b for b in data[i:i + 16])
+				f.write("\t%s,\n" % row)
+			f.write("};\n")
+	else:
+		with open(args[0], "wb") as f:
+			f.write(data)
+
+	print("%s: %d patches, %d bytes" % (args[0], len(patches), len(data)))
+	if symbol:
+		print("%s: %d names" % (header, len(patches)))
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
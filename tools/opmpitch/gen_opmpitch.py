@@ -0,0 +1,42 @@
+#!/usr/bin/python3
+# gen_opmpitch - generates the lookup tables for xbase/util/opmpitch.
+#
+# usage: gen_opmpitch.py output.c
+#
+# mike moffitt
+import math
+import sys
+
+OCTAVES = 8
+# KC note codes from C# up to C; codes 3, 7 and B (OPM_NOTE_X1 - X3) are not
+# used.
+NOTE_CODES = [0x0, 0x1, 0x2, 0x4, 0x5, 0x6, 0x8, 0x9, 0xA, 0xC, 0xD, 0xE]
+SINE_STEPS = 64
+
+
+def table(f, ctype, name, vals, fmt):
+	f.write("const %s %s[%d] =\n{\n" % (ctype, name, len(vals)))
+	for i in range(0, len(vals), 12):
+		f.write("\t%s,\n" % ", ".join(fmt % v for v in vals[i:i + 12]))
+	f.write("};\n")
+
+
+def main(argv):
+	if len(argv) != 2:
+		print("usage: %s output.c" % argv[0])
+		return 1
+	kc = [(octave << 4) | code for octave in range(OCTAVES) for code in NOTE_CODES]
+	sine = [int(round(127 * math.sin(2 * math.pi * i / SINE_STEPS)))
+	        for i in range(SINE_STEPS)]
+	with open(argv[1], "w") as f:
+		f.write("// Generated by tools/opmpitch/gen_opmpitch.py; do not edit.\n")
+		f.write("#include \"xbase/util/opmpitch.h\"\n\n")
+		f.write("// KC for each semitone, starting from C# in octave 0.\n")
+		table(f, "uint8_t", "g_xb_opmpitch_kc", kc, "0x%02X")
+		f.write("\n// One sine cycle, -127 to 127.\n")
+		table(f, "int8_t", "g_xb_opmpitch_sine", sine, "%d")
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
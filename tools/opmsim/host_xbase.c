@@ -0,0 +1,78 @@
+// Host versions of the xbase pieces that are written in assembly or touch
+// hardware, for the OPM stand-in build. These follow opm_commit.a68 and
+// opm_patch.a68, so the write order matches the target.
+#include "xbase/opm.h"
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+
+#include <stddef.h>
+
+volatile uint16_t g_xb_opm_reg_cache[0x100];
+volatile uint8_t g_xb_opm_dirty_bitmap[XB_OPM_DIRTY_BYTES];
+
+void xb_opm_commit(void)
+{
+	// Highest register first, so key on ($08) goes last.
+	for (int16_t byte = XB_OPM_DIRTY_BYTES - 1; byte >= 0; byte--)
+	{
+		const uint8_t bits = g_xb_opm_dirty_bitmap[byte];
+		if (!bits) continue;
+		g_xb_opm_dirty_bitmap[byte] = 0;
+		for (int16_t bit = 7; bit >= 0; bit--)
+		{
+			if (!(bits & (1 << bit))) continue;
+			const uint8_t addr = (byte * 8) + bit;
+			const uint16_t entry = g_xb_opm_reg_cache[addr];
+			if (!(entry & XB_OPM_CACHE_PENDING)) continue;
+			g_xb_opm_reg_cache[addr] = XB_OPM_CACHE_SENT | (entry & 0xFF);
+			xb_opm_sim_write(addr, entry & 0xFF);
+		}
+	}
+}
+
+static uint16_t load_patch_reg(uint8_t addr, uint8_t data)
+{
+	const uint16_t entry = g_xb_opm_reg_cache[addr];
+	if ((entry & (XB_OPM_CACHE_PENDING | XB_OPM_CACHE_SENT)) &&
+	    (entry & 0xFF) == data)
+	{
+		return 0;
+	}
+	xb_opm_set(addr, data);
+	return 1;
+}
+
+uint16_t xb_opm_load_patch(uint8_t channel, const XBOpmPatch *patch)
+{
+	const uint16_t entry = g_xb_opm_reg_cache[OPM_CH_PAN_FL_CON + channel];
+	const uint8_t pan = (entry & (XB_OPM_CACHE_PENDING | XB_OPM_CACHE_SENT)) ?
+	                    (entry & OPM_PAN_BOTH) : OPM_PAN_BOTH;
+	uint16_t count = load_patch_reg(OPM_CH_PAN_FL_CON + channel,
+	                                pan | patch->fl_con);
+	const uint8_t *src = &patch->pms_ams;
+	for (uint16_t addr = OPM_CH_PMS_AMS + channel; addr <= OPM_REG_MAX;
+	     addr += 8)
+	{
+		count += load_patch_reg(addr, *src++);
+	}
+	return count;
+}
+
+uint8_t xb_set_ipl(uint8_t ipl)
+{
+	(void)ipl;
+	return XB_IPL_ALLOW_ALL;
+}
+
+void *xb_mfp_set_interrupt(uint16_t vector, void (*interrupt_handler)(void))
+{
+	(void)vector;
+	(void)interrupt_handler;
+	return NULL;
+}
+
+void xb_mfp_set_interrupt_enable(uint16_t vector, bool enabled)
+{
+	(void)vector;
+	(void)enabled;
+}
@@ -0,0 +1,484 @@
+// opmsim - runs the xbase OPM drivers on the host against a YM2151 stand-in.
+//
+// usage:
+//   opmsim seq song.bin [-f frames] [-q us] [-t trace.txt] [-v]
+//   opmsim stream stream.bin [-f frames] [-q us] [-t trace.txt] [-v]
+//   opmsim diff a.txt b.txt
+//
+// One frame is one driver tick (a Timer B period). The stand-in counts time in
+// 10MHz 68000 cycles. Each write costs XB_OPMSIM_WRITE_CYCLES, and after the
+// data is written the chip is busy for XB_OPMSIM_BUSY_CYCLES; a write made
+// while it is busy stalls until it is not. For each frame it counts writes,
+// redundant writes (data equal to what the register already held) and stall
+// cycles.
+//
+// With -q, writes go through a model of the OPM write queue (opm_queue.a68)
+// instead, with a Timer A period of the given number of microseconds: a write
+// costs a push, and a timer interrupt sends one write per period, finding the
+// chip busy or the queue empty on the other ticks. Interrupt time is counted
+// but does not delay the driver. Both paths report the CPU cycles spent on OPM
+// writes, so their costs can be compared on the same song.
+//
+// The trace has one line per write: frame, cycle, register, data. diff replays
+// two traces and compares the chip state at the end of every frame, so a
+// driver change can be checked to produce the same sound with different
+// writes. It exits with 1 if the state differs.
+#include "xbase/opm.h"
+#include "xbase/util/opmseq.h"
+#include "xbase/util/opmstream.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CPU_HZ 10000000ULL
+#define OPM_HZ 4000000ULL
+
+// 68000 cycles spent by one address / data write pair, without stalls.
+#ifndef XB_OPMSIM_WRITE_CYCLES
+#define XB_OPMSIM_WRITE_CYCLES 40
+#endif
+// Busy time after a data write: 64 OPM clocks.
+#ifndef XB_OPMSIM_BUSY_CYCLES
+#define XB_OPMSIM_BUSY_CYCLES ((64 * CPU_HZ) / OPM_HZ)
+#endif
+#define STATUS_POLL_CYCLES 12
+
+// Costs of the queue path, counted from the 68000 timings of opm_queue.a68
+// (interrupt acknowledge and rte included).
+#define QUEUE_PUSH_CYCLES 270  // xb_opm_commit's call and opm_queue_push_sub.
+#define QUEUE_SEND_CYCLES 334  // An interrupt that sends a write.
+#define QUEUE_BUSY_CYCLES 194  // An interrupt that finds the chip busy.
+#define QUEUE_STOP_CYCLES 246  // An interrupt that finds the queue empty.
+#define QUEUE_DEPTH 256
+
+// Chip state for comparing traces: every register, plus key on per channel
+// and the AM / PM halves of the LFO depth register, which share an address.
+#define STATE_KEY 0x100
+#define STATE_AMD (STATE_KEY + 8)
+#define STATE_PMD (STATE_AMD + 1)
+#define STATE_SIZE (STATE_PMD + 1)
+
+typedef struct FrameStats
+{
+	uint32_t writes;
+	uint32_t redundant;
+	uint64_t stall_cycles;
+	uint64_t cpu_cycles;  // Spent on OPM writes, either path.
+} FrameStats;
+
+typedef struct QueueEntry
+{
+	uint32_t frame;
+	uint8_t addr;
+	uint8_t data;
+} QueueEntry;
+
+static struct
+{
+	uint64_t now;
+	uint64_t busy_until;
+	uint32_t frame;
+	int16_t state[STATE_SIZE];  // -1 until written
+	FrameStats cur;
+	FrameStats total;
+	uint32_t max_writes;
+	uint32_t max_writes_frame;
+	FILE *trace;
+	bool verbose;
+
+	// Queue model; queue_cycles is 0 for the direct path.
+	uint64_t queue_cycles;
+	QueueEntry queue[QUEUE_DEPTH];
+	uint16_t queue_r;
+	uint16_t queue_w;
+	bool queue_running;
+	uint64_t queue_next_tick;
+	uint32_t queue_sends;
+	uint32_t queue_busy_ticks;
+	uint32_t queue_full_sends;
+} s_sim;
+
+static void state_reset(int16_t *state)
+{
+	for (int i = 0; i < STATE_SIZE; i++) state[i] = -1;
+}
+
+// Applies a write to a state image. Returns true if it changed nothing.
+static bool state_apply(int16_t *state, uint8_t addr, uint8_t data)
+{
+	int idx = addr;
+	if (addr == OPM_REG_KEY_ON)
+	{
+		idx = STATE_KEY + (data & 0x07);
+		data &= 0x78;
+	}
+	else if (addr == OPM_REG_LFO_DEPTH)
+	{
+		idx = (data & 0x80) ? STATE_PMD : STATE_AMD;
+	}
+	const bool same = state[idx] == data;
+	state[idx] = data;
+	return same;
+}
+
+//
+// Stand-in
+//
+
+// The chip receiving a write at cycle when. frame is the frame it was made in.
+static void chip_write(uint32_t frame, uint64_t when, uint8_t addr,
+                       uint8_t data)
+{
+	s_sim.busy_until = when + XB_OPMSIM_BUSY_CYCLES;
+	s_sim.cur.writes++;
+	if (state_apply(s_sim.state, addr, data)) s_sim.cur.redundant++;
+	if (s_sim.trace)
+	{
+		fprintf(s_sim.trace, "%u %llu %02X %02X\n", frame,
+		        (unsigned long long)when, addr, data);
+	}
+}
+
+// Runs the queue's timer interrupts up to cycle until.
+static void queue_run(uint64_t until)
+{
+	while (s_sim.queue_running && s_sim.queue_next_tick <= until)
+	{
+		const uint64_t tick = s_sim.queue_next_tick;
+		s_sim.queue_next_tick += s_sim.queue_cycles;
+		if (tick < s_sim.busy_until)
+		{
+			s_sim.queue_busy_ticks++;
+			s_sim.cur.cpu_cycles += QUEUE_BUSY_CYCLES;
+		}
+		else if (s_sim.queue_r == s_sim.queue_w)
+		{
+			s_sim.queue_running = false;
+			s_sim.cur.cpu_cycles += QUEUE_STOP_CYCLES;
+		}
+		else
+		{
+			const QueueEntry *e = &s_sim.queue[s_sim.queue_r++ % QUEUE_DEPTH];
+			chip_write(e->frame, tick + QUEUE_SEND_CYCLES / 2, e->addr, e->data);
+			s_sim.queue_sends++;
+			s_sim.cur.cpu_cycles += QUEUE_SEND_CYCLES;
+		}
+	}
+}
+
+static void queue_push(uint8_t addr, uint8_t data)
+{
+	queue_run(s_sim.now);
+	s_sim.now += QUEUE_PUSH_CYCLES;
+	s_sim.cur.cpu_cycles += QUEUE_PUSH_CYCLES;
+	if ((uint16_t)(s_sim.queue_w - s_sim.queue_r) >= QUEUE_DEPTH - 1)
+	{
+		// Full: the push sends the oldest write itself, as the direct path.
+		const QueueEntry *e = &s_sim.queue[s_sim.queue_r++ % QUEUE_DEPTH];
+		const uint64_t start = s_sim.now;
+		if (s_sim.now < s_sim.busy_until)
+		{
+			s_sim.cur.stall_cycles += s_sim.busy_until - s_sim.now;
+			s_sim.now = s_sim.busy_until;
+		}
+		s_sim.now += XB_OPMSIM_WRITE_CYCLES;
+		s_sim.cur.cpu_cycles += s_sim.now - start;
+		chip_write(e->frame, s_sim.now, e->addr, e->data);
+		s_sim.queue_full_sends++;
+	}
+	QueueEntry *e = &s_sim.queue[s_sim.queue_w++ % QUEUE_DEPTH];
+	e->frame = s_sim.frame;
+	e->addr = addr;
+	e->data = data;
+	if (!s_sim.queue_running)
+	{
+		s_sim.queue_running = true;
+		s_sim.queue_next_tick = s_sim.now + s_sim.queue_cycles;
+	}
+}
+
+void xb_opm_sim_write(uint8_t addr, uint8_t data)
+{
+	if (s_sim.queue_cycles)
+	{
+		queue_push(addr, data);
+		return;
+	}
+	const uint64_t start = s_sim.now;
+	if (s_sim.now < s_sim.busy_until)
+	{
+		s_sim.cur.stall_cycles += s_sim.busy_until - s_sim.now;
+		s_sim.now = s_sim.busy_until;
+	}
+	s_sim.now += XB_OPMSIM_WRITE_CYCLES;
+	s_sim.cur.cpu_cycles += s_sim.now - start;
+	chip_write(s_sim.frame, s_sim.now, addr, data);
+}
+
+uint8_t xb_opm_sim_status(void)
+{
+	s_sim.now += STATUS_POLL_CYCLES;
+	return (s_sim.now < s_sim.busy_until) ? 0x80 : 0x00;
+}
+
+static void add_frame_stats(void)
+{
+	if (s_sim.verbose && s_sim.cur.writes)
+	{
+		printf("frame %6u: %3u writes, %3u redundant, %6llu stall cycles, "
+		       "%6llu CPU cycles\n", s_sim.frame, s_sim.cur.writes,
+		       s_sim.cur.redundant, (unsigned long long)s_sim.cur.stall_cycles,
+		       (unsigned long long)s_sim.cur.cpu_cycles);
+	}
+	s_sim.total.writes += s_sim.cur.writes;
+	s_sim.total.redundant += s_sim.cur.redundant;
+	s_sim.total.stall_cycles += s_sim.cur.stall_cycles;
+	s_sim.total.cpu_cycles += s_sim.cur.cpu_cycles;
+	if (s_sim.cur.writes > s_sim.max_writes)
+	{
+		s_sim.max_writes = s_sim.cur.writes;
+		s_sim.max_writes_frame = s_sim.frame;
+	}
+	memset(&s_sim.cur, 0, sizeof(s_sim.cur));
+}
+
+static void end_frame(void)
+{
+	add_frame_stats();
+	s_sim.frame++;
+}
+
+//
+// Running drivers
+//
+
+static uint8_t *load_file(const char *path, long *len)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+	{
+		perror(path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *data = malloc(*len);
+	if (fread(data, 1, *len, f) != (size_t)*len)
+	{
+		perror(path);
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+static int run(bool stream, int argc, char **argv)
+{
+	const char *path = NULL;
+	const char *trace_path = NULL;
+	uint32_t frames = 60 * 60;
+	for (int i = 0; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-f") && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc) trace_path = argv[++i];
+		else if (!strcmp(argv[i], "-q") && i + 1 < argc)
+		{
+			s_sim.queue_cycles = (atoi(argv[++i]) * CPU_HZ) / 1000000;
+		}
+		else if (!strcmp(argv[i], "-v")) s_sim.verbose = true;
+		else path = argv[i];
+	}
+	if (!path)
+	{
+		fprintf(stderr, "no input file\n");
+		return 1;
+	}
+
+	long len;
+	uint8_t *data = load_file(path, &len);
+	if (!data) return 1;
+	if (len < 4 || data[0] != (stream ? 'V' : 'O') || data[1] != 'S')
+	{
+		fprintf(stderr, "%s: not a %s file\n", path, stream ? "stream" : "song");
+		return 1;
+	}
+	if (trace_path)
+	{
+		s_sim.trace = fopen(trace_path, "w");
+		if (!s_sim.trace)
+		{
+			perror(trace_path);
+			return 1;
+		}
+	}
+
+	state_reset(s_sim.state);
+	const uint64_t tick_cycles = (1024 * (256 - data[2]) * CPU_HZ) / OPM_HZ;
+
+	if (stream) xb_opmstream_play(data);
+	else xb_opmseq_play(data);
+	end_frame();  // Writes made when starting count as a frame of their own.
+
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		const uint64_t start = (uint64_t)(i + 1) * tick_cycles;
+		queue_run(start);
+		if (s_sim.now < start) s_sim.now = start;
+		if (stream)
+		{
+			if (!xb_opmstream_is_playing()) break;
+			xb_opmstream_tick();
+		}
+		else
+		{
+			if (!xb_opmseq_is_playing()) break;
+			xb_opmseq_tick();
+		}
+		end_frame();
+	}
+
+	// Writes still queued are sent after the last frame.
+	queue_run(UINT64_MAX);
+	add_frame_stats();
+
+	const double seconds = (double)(s_sim.frame - 1) * tick_cycles / CPU_HZ;
+	printf("%s: %u frames (%.1fs, %llu cycles per frame)\n", path,
+	       s_sim.frame, seconds, (unsigned long long)tick_cycles);
+	printf("  writes:       %u (%.1f per second)\n", s_sim.total.writes,
+	       seconds > 0 ? s_sim.total.writes / seconds : 0.0);
+	printf("  redundant:    %u\n", s_sim.total.redundant);
+	printf("  stall cycles: %llu\n",
+	       (unsigned long long)s_sim.total.stall_cycles);
+	printf("  most writes:  %u (frame %u)\n", s_sim.max_writes,
+	       s_sim.max_writes_frame);
+	printf("  CPU cycles:   %llu (%.0f per write, %.2f%% of the CPU)\n",
+	       (unsigned long long)s_sim.total.cpu_cycles,
+	       s_sim.total.writes ?
+	       (double)s_sim.total.cpu_cycles / s_sim.total.writes : 0.0,
+	       seconds > 0 ? 100.0 * s_sim.total.cpu_cycles / (seconds * CPU_HZ) :
+	       0.0);
+	if (s_sim.queue_cycles)
+	{
+		printf("  queue:        %u sent by the timer, %u busy ticks, "
+		       "%u sent by a full push\n", s_sim.queue_sends,
+		       s_sim.queue_busy_ticks, s_sim.queue_full_sends);
+	}
+
+	if (s_sim.trace) fclose(s_sim.trace);
+	free(data);
+	return 0;
+}
+
+//
+// Trace comparison
+//
+
+typedef struct Trace
+{
+	FILE *f;
+	bool has_line;
+	uint32_t frame;
+	uint8_t addr;
+	uint8_t data;
+	int16_t state[STATE_SIZE];
+	uint32_t writes;
+} Trace;
+
+static void trace_next(Trace *t)
+{
+	unsigned int frame, addr, data;
+	unsigned long long cycle;
+	t->has_line = fscanf(t->f, "%u %llu %x %x", &frame, &cycle, &addr,
+	                     &data) == 4;
+	t->frame = frame;
+	t->addr = addr;
+	t->data = data;
+}
+
+// Applies the writes for one frame.
+static void trace_frame(Trace *t, uint32_t frame, uint32_t *writes)
+{
+	*writes = 0;
+	while (t->has_line && t->frame == frame)
+	{
+		state_apply(t->state, t->addr, t->data);
+		(*writes)++;
+		trace_next(t);
+	}
+	t->writes += *writes;
+}
+
+static int diff(const char *path_a, const char *path_b)
+{
+	Trace t[2];
+	const char *paths[2] = {path_a, path_b};
+	for (int i = 0; i < 2; i++)
+	{
+		memset(&t[i], 0, sizeof(t[i]));
+		t[i].f = fopen(paths[i], "r");
+		if (!t[i].f)
+		{
+			perror(paths[i]);
+			return 1;
+		}
+		state_reset(t[i].state);
+		trace_next(&t[i]);
+	}
+
+	uint32_t differing = 0;
+	uint32_t frame = 0;
+	while (t[0].has_line || t[1].has_line)
+	{
+		uint32_t writes[2];
+		trace_frame(&t[0], frame, &writes[0]);
+		trace_frame(&t[1], frame, &writes[1]);
+		if (memcmp(t[0].state, t[1].state, sizeof(t[0].state)))
+		{
+			if (differing < 10)
+			{
+				printf("frame %u differs (%u / %u writes):", frame, writes[0],
+				       writes[1]);
+				int shown = 0;
+				for (int i = 0; i < STATE_SIZE; i++)
+				{
+					if (t[0].state[i] == t[1].state[i]) continue;
+					if (++shown > 8)
+					{
+						printf(" ...");
+						break;
+					}
+					if (i >= STATE_KEY) printf(" key/lfo%d", i - STATE_KEY);
+					else printf(" $%02X", i);
+					printf("=%d/%d", t[0].state[i], t[1].state[i]);
+				}
+				printf("\n");
+			}
+			differing++;
+		}
+		frame++;
+	}
+
+	printf("%u frames, %u with different state\n", frame, differing);
+	printf("writes: %u / %u\n", t[0].writes, t[1].writes);
+	fclose(t[0].f);
+	fclose(t[1].f);
+	return differing ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 3 && !strcmp(argv[1], "seq")) return run(false, argc - 2, argv + 2);
+	if (argc >= 3 && !strcmp(argv[1], "stream")) return run(true, argc - 2, argv + 2);
+	if (argc == 4 && !strcmp(argv[1], "diff")) return diff(argv[2], argv[3]);
+	fprintf(stderr,
+	        "usage: %s seq song.bin [-f frames] [-q us] [-t trace.txt] [-v]\n"
+	        "       %s stream stream.bin [-f frames] [-q us] [-t trace.txt] "
+	        "[-v]\n"
+	        "       %s diff a.txt b.txt\n", argv[0], argv[0], argv[0]);
+	return 1;
+}
@@ -0,0 +1,465 @@
+#!/usr/bin/python3
+# vgm2opm - converts the YM2151 part of a VGM file into a register stream for
+# xbase/util/opmstream.
+#
+# usage: vgm2opm.py input.vgm output.bin [--c symbol_name] [--rate hz]
+#                   [--no-clock-adjust]
+#
+# Compressed .vgz files are accepted as well.
+#
+# The conversion:
+#  - quantizes each write to the player tick (Timer B, --rate Hz, default 60)
+#  - keeps only the last value written to each register within a tick
+#  - drops writes that leave a register as it already was
+#  - merges the waits between ticks into one command
+#  - drops writes to the timer and test registers, which the player owns
+#  - shifts KC / KF for the X68000's 4MHz OPM clock, if the VGM was made for
+#    another clock (usually 3.58MHz)
+#
+# At the loop point, registers that differ between the loop start and the end
+# of the song are set back before jumping, since writes after the loop point
+# were reduced against the state of the first pass.
+#
+# The output is checked as the player would run it: every wait is 1 - 255
+# ticks, the loop waits at least one tick (or the player would run it again
+# and again within one tick), and a warning is printed for ticks with more
+# commands than the player runs at once (XB_OPMSTREAM_CMD_LIMIT), which are
+# spread over two.
+#
+# mike moffitt
+import gzip
+import math
+import struct
+import sys
+
+# Commands, matching xbase/util/opmstream.h.
+CMD_WAIT = 0x01
+CMD_KEY = 0x02
+CMD_DIRECT = 0x03
+CMD_COMMIT = 0x04
+CMD_LOOP = 0x05
+CMD_END = 0x06
+CMD_SET_MIN = 0x20
+HEADER_BYTES = 0x0C
+# Commands the player runs per tick before leaving the rest for the next one.
+CMD_LIMIT = 256
+
+VGM_SAMPLE_RATE = 44100
+X68K_OPM_CLOCK = 4000000
+
+REG_KEY_ON = 0x08
+REG_LFO_DEPTH = 0x19
+REG_CONTROL = 0x1B
+# Timer registers and test mode belong to the player.
+DROPPED_REGS = {0x01, 0x10, 0x11, 0x12, 0x14}
+# CT1 selects the ADPCM clock on the X68000, so only the LFO wave is kept.
+CONTROL_MASK = 0x03
+
+KC_CODES = [0x0, 0x1, 0x2, 0x4, 0x5, 0x6, 0x8, 0x9, 0xA, 0xC, 0xD, 0xE]
+PITCH_MAX = 8 * 12 * 64 - 1
+
+# Operand byte counts for VGM commands this tool skips.
+def vgm_skip_len(cmd):
+	if 0x30 <= cmd <= 0x3F:
+		return 1
+	if 0x40 <= cmd <= 0x4E:
+		return 2
+	if cmd in (0x4F, 0x50):
+		return 1
+	if 0x51 <= cmd <= 0x5F:
+		return 2
+	if cmd == 0x68:
+		return 11
+	if cmd in (0x90, 0x91, 0x95):
+		return 4
+	if cmd == 0x92:
+		return 5
+	if cmd == 0x93:
+		return 10
+	if cmd == 0x94:
+		return 1
+	if 0xA0 <= cmd <= 0xBF:
+		return 2
+	if 0xC0 <= cmd <= 0xDF:
+		return 3
+	if 0xE0 <= cmd <= 0xFF:
+		return 4
+	return None
+
+
+class VgmError(Exception):
+	pass
+
+
+def read_vgm(path):
+	with open(path, "rb") as f:
+		data = f.read()
+	if data[:2] == b"\x1f\x8b":
+		data = gzip.decompress(data)
+	if data[:4] != b"Vgm ":
+		raise VgmError("not a VGM file")
+	version = struct.unpack_from("<I", data, 0x08)[0]
+	loop_rel = struct.unpack_from("<I", data, 0x1C)[0]
+	loop_pos = (0x1C + loop_rel) if loop_rel else None
+	clock = struct.unpack_from("<I", data, 0x30)[0] & 0x3FFFFFFF
+	if not clock:
+		raise VgmError("no YM2151 in this file")
+	data_pos = 0x40
+	if version >= 0x150:
+		rel = struct.unpack_from("<I", data, 0x34)[0]
+		if rel:
+			data_pos = 0x34 + rel
+
+	# Returns a list of (sample, reg, value), and the sample of the loop point.
+	events = []
+	sample = 0
+	loop_sample = None
+	pos = data_pos
+	while pos < len(data):
+		if pos == loop_pos:
+			loop_sample = sample
+		cmd = data[pos]
+		pos += 1
+		if cmd == 0x54:
+			events.append((sample, data[pos], data[pos + 1]))
+			pos += 2
+		elif cmd == 0x61:
+			sample += struct.unpack_from("<H", data, pos)[0]
+			pos += 2
+		elif cmd == 0x62:
+			sample += 735
+		elif cmd == 0x63:
+			sample += 882
+		elif 0x70 <= cmd <= 0x7F:
+			sample += (cmd & 0x0F) + 1
+		elif 0x80 <= cmd <= 0x8F:
+			sample += cmd & 0x0F
+		elif cmd == 0x66:
+			break
+		elif cmd == 0x67:
+			size = struct.unpack_from("<I", data, pos + 2)[0]
+			pos += 6 + size
+		else:
+			skip = vgm_skip_len(cmd)
+			if skip is None:
+				raise VgmError("unknown command $%02X at $%X" % (cmd, pos - 1))
+			pos += skip
+	return {
+		"size": len(data),
+		"clock": clock,
+		"events": events,
+		"end_sample": sample,
+		"loop_sample": loop_sample,
+	}
+
+
+def timer_b_for_rate(hz):
+	period = int(round(256 - X68K_OPM_CLOCK / (1024.0 * hz)))
+	return max(0, min(255, period))
+
+
+def timer_b_rate(period):
+	return X68K_OPM_CLOCK / (1024.0 * (256 - period))
+
+
+class PitchShift:
+	# Re-tunes KC / KF written for one clock to play at the same pitch on
+	# another, in 1/64 semitone units.
+	def __init__(self, src_clock, dst_clock):
+		self.adjust = int(round(12 * 64 * math.log2(src_clock / dst_clock)))
+
+	def convert(self, kc, kf):
+		if not self.adjust:
+			return kc, kf
+		code = kc & 0x0F
+		# Unused codes play as the note below them.
+		semi = max(i for i, c in enumerate(KC_CODES) if c <= code)
+		pitch = (((kc >> 4) & 7) * 12 + semi) * 64 + (kf >> 2) + self.adjust
+		pitch = max(0, min(PITCH_MAX, pitch))
+		semi = pitch >> 6
+		kc = ((semi // 12) << 4) | KC_CODES[semi % 12]
+		kf = (pitch & 0x3F) << 2
+		return kc, kf
+
+
+class Converter:
+	def __init__(self, shift):
+		self.shift = shift
+		self.state = {}      # register values as sent to the chip
+		self.src_kc = {}     # untranslated KC / KF per channel
+		self.src_kf = {}
+		self.key = [0] * 8   # key on slot mask per channel
+		self.out = bytearray()
+		self.writes = 0
+		self.max_tick_writes = 0
+
+	def translate(self, reg, val):
+		# Returns a list of (reg, value) to send for a source write.
+		if reg in DROPPED_REGS:
+			return []
+		if reg == REG_CONTROL:
+			return [(reg, val & CONTROL_MASK)]
+		if 0x28 <= reg <= 0x37:
+			ch = reg & 7
+			if reg < 0x30:
+				self.src_kc[ch] = val
+			else:
+				self.src_kf[ch] = val
+			kc, kf = self.shift.convert(self.src_kc.get(ch, 0),
+			                            self.src_kf.get(ch, 0))
+			return [(0x28 + ch, kc), (0x30 + ch, kf)]
+		return [(reg, val)]
+
+	def emit_tick(self, writes):
+		# writes: source (reg, value) list in order for this tick.
+		cached = {}
+		direct = []
+		key_start = list(self.key)
+		key_low = list(self.key)
+		key_end = list(self.key)
+		for reg, val in writes:
+			if reg == REG_KEY_ON:
+				ch = val & 7
+				mask = (val >> 3) & 0x0F
+				key_low[ch] &= mask
+				key_end[ch] = mask
+				continue
+			for r, v in self.translate(reg, val):
+				if r == REG_LFO_DEPTH:
+					# AMD and PMD share this register, so each write counts.
+					key = (r, v & 0x80)
+					if self.state.get(key) != v:
+						self.state[key] = v
+						direct.append((r, v))
+				elif r < 0x20:
+					if self.state.get(r) != v:
+						self.state[r] = v
+						direct.append((r, v))
+				else:
+					cached[r] = v
+
+		count = 0
+		# Key off (or the off half of a retrigger) goes before the new data.
+		for ch in range(8):
+			if key_low[ch] != key_start[ch]:
+				self.out += bytes([CMD_KEY, (key_low[ch] << 3) | ch])
+				count += 1
+		for r, v in direct:
+			self.out += bytes([CMD_DIRECT, r, v])
+			count += 1
+		sets = 0
+		for r in sorted(cached):
+			v = cached[r]
+			if self.state.get(r) == v:
+				continue
+			self.state[r] = v
+			self.out += bytes([r, v])
+			sets += 1
+		if sets:
+			self.out.append(CMD_COMMIT)
+		count += sets
+		# Key on after the data is in place.
+		for ch in range(8):
+			if key_end[ch] != key_low[ch]:
+				self.out += bytes([CMD_KEY, (key_end[ch] << 3) | ch])
+				count += 1
+		self.key = key_end
+		self.writes += count
+		self.max_tick_writes = max(self.max_tick_writes, count)
+		return count
+
+	def emit_wait(self, ticks):
+		assert ticks >= 0
+		while ticks > 0:
+			n = min(ticks, 255)
+			self.out += bytes([CMD_WAIT, n])
+			ticks -= n
+
+	def snapshot(self):
+		return dict(self.state), list(self.key)
+
+	def emit_restore(self, snap):
+		# Sets registers back to the state at the loop point. These values
+		# are already translated, so they bypass translate().
+		state, key = snap
+		count = 0
+		for ch in range(8):
+			if self.key[ch] & ~key[ch]:
+				low = self.key[ch] & key[ch]
+				self.out += bytes([CMD_KEY, (low << 3) | ch])
+				self.key[ch] = low
+				count += 1
+		sets = 0
+		for k, v in sorted(state.items(), key=lambda kv: str(kv[0])):
+			if self.state.get(k) == v:
+				continue
+			r = k if isinstance(k, int) else k[0]
+			if r < 0x20:
+				self.out += bytes([CMD_DIRECT, r, v])
+				count += 1
+			else:
+				self.out += bytes([r, v])
+				sets += 1
+		if sets:
+			self.out.append(CMD_COMMIT)
+		for ch in range(8):
+			if self.key[ch] != key[ch]:
+				self.out += bytes([CMD_KEY, (key[ch] << 3) | ch])
+				count += 1
+		self.writes += count + sets
+		return count + sets
+
+
+def convert(vgm, rate, clock_adjust):
+	period = timer_b_for_rate(rate)
+	tick_hz = timer_b_rate(period)
+	shift = PitchShift(vgm["clock"] if clock_adjust else X68K_OPM_CLOCK,
+	                   X68K_OPM_CLOCK)
+	conv = Converter(shift)
+
+	def to_tick(sample):
+		return int(sample * tick_hz / VGM_SAMPLE_RATE + 0.5)
+
+	# Group writes by tick, keeping their order.
+	ticks = {}
+	for sample, reg, val in vgm["events"]:
+		ticks.setdefault(to_tick(sample), []).append((reg, val))
+	end_tick = to_tick(vgm["end_sample"])
+	loop_tick = None
+	if vgm["loop_sample"] is not None:
+		loop_tick = to_tick(vgm["loop_sample"])
+		ticks.setdefault(loop_tick, [])
+	end_tick = max([end_tick] + [t + 1 for t in ticks])
+
+	loop_offs = 0
+	loop_snap = None
+	tick_list = sorted(ticks)
+	for i, t in enumerate(tick_list):
+		if t == loop_tick:
+			loop_offs = HEADER_BYTES + len(conv.out)
+			loop_snap = conv.snapshot()
+		conv.emit_tick(ticks[t])
+		next_t = tick_list[i + 1] if i + 1 < len(tick_list) else end_tick
+		conv.emit_wait(next_t - t)
+
+	if loop_snap is not None:
+		# The restore runs on the same tick as the first loop tick.
+		conv.emit_restore(loop_snap)
+		conv.out.append(CMD_LOOP)
+	else:
+		conv.out.append(CMD_END)
+
+	header = bytearray(b"VS")
+	header += bytes([period, 0])
+	header += struct.pack(">II", loop_offs, end_tick)
+	return bytes(header) + bytes(conv.out), conv, tick_hz, end_tick
+
+
+def check_stream(data):
+	# Steps through the stream as xb_opmstream_tick() does, through the loop
+	# once. Returns the most commands run in one tick.
+	loop_offs = struct.unpack_from(">I", data, 4)[0]
+	pos = HEADER_BYTES
+	cmds = 0
+	most = 0
+	loop_wait = None  # Ticks waited since the loop point.
+	looped = False
+	while True:
+		if loop_offs and pos == loop_offs and loop_wait is None:
+			loop_wait = 0
+		cmd = data[pos]
+		cmds += 1
+		if cmd >= CMD_SET_MIN or cmd == CMD_KEY:
+			pos += 2
+		elif cmd == CMD_DIRECT:
+			pos += 3
+		elif cmd == CMD_COMMIT:
+			pos += 1
+		elif cmd == CMD_WAIT:
+			if data[pos + 1] == 0:
+				raise VgmError("wait of 0 ticks at $%X" % pos)
+			if loop_wait is not None:
+				loop_wait += data[pos + 1]
+			pos += 2
+			most = max(most, cmds)
+			cmds = 0
+			if looped:
+				break
+		elif cmd == CMD_LOOP and loop_offs and not looped:
+			if not loop_wait:
+				raise VgmError("the loop has no length")
+			pos = loop_offs
+			looped = True
+		elif cmd in (CMD_LOOP, CMD_END):
+			break
+		else:
+			raise VgmError("bad command $%02X at $%X" % (cmd, pos))
+	return max(most, cmds)
+
+
+def write_c(path, symbol, data):
+	with open(path, "w") as f:
+		f.write("// Generated by vgm2opm.py\n")
+		f.write("#include <stdint.h>\n\n")
+		f.write("const uint8_t %s[%d] =\n{\n" % (symbol, len(data)))
+		for i in range(0, len(data), 16):
+			row = ", ".join("0x%02X" % b for b in data[i:i + 16])
+			f.write("\t%s,\n" % row)
+		f.write("};\n")
+
+
+def main(argv):
+	args = argv[1:]
+	symbol = None
+	rate = 60.0
+	clock_adjust = True
+	paths = []
+	while args:
+		a = args.pop(0)
+		if a == "--c":
+			symbol = args.pop(0)
+		elif a == "--rate":
+			rate = float(args.pop(0))
+		elif a == "--no-clock-adjust":
+			clock_adjust = False
+		else:
+			paths.append(a)
+	if len(paths) != 2:
+		print("usage: %s input.vgm output [--c symbol_name] [--rate hz] "
+		      "[--no-clock-adjust]" % argv[0])
+		return 1
+
+	try:
+		vgm = read_vgm(paths[0])
+		data, conv, tick_hz, end_tick = convert(vgm, rate, clock_adjust)
+		most_cmds = check_stream(data)
+	except VgmError as e:
+		print("%s: %s" % (paths[0], e), file=sys.stderr)
+		return 1
+
+	if symbol:
+		write_c(paths[1], symbol, data)
+	else:
+		with open(paths[1], "wb") as f:
+			f.write(data)
+
+	seconds = vgm["end_sample"] / float(VGM_SAMPLE_RATE)
+	src_writes = len(vgm["events"])
+	print("%s: %d -> %d bytes (%.1f%%)" %
+	      (paths[1], vgm["size"], len(data), 100.0 * len(data) / vgm["size"]))
+	print("  tick %.2fHz (Timer B %d), %d ticks, %.1fs" %
+	      (tick_hz, data[2], end_tick, seconds))
+	print("  writes: %d -> %d" % (src_writes, conv.writes))
+	if seconds > 0:
+		print("  writes per second: %.1f -> %.1f" %
+		      (src_writes / seconds, conv.writes / seconds))
+	print("  most writes in one tick: %d" % conv.max_tick_writes)
+	if most_cmds > CMD_LIMIT:
+		print("warning: a tick has %d commands, more than the player runs at "
+		      "once (%d); it will be spread over two" % (most_cmds, CMD_LIMIT),
+		      file=sys.stderr)
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
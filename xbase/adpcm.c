@@ -0,0 +1,325 @@
+#include "xbase/adpcm.h"
+
+#include "xbase/ipl.h"
+#include "xbase/memmap.h"
+#include "xbase/mfp.h"
+#include "xbase/opm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ADPCM_CMD_STOP 0x01
+#define ADPCM_CMD_PLAY 0x02
+
+// Encoded silence: alternating +/- the smallest step, which leaves an encoder
+// at rest (predictor 0, smallest step) where it was.
+#define ADPCM_SILENCE 0x80
+
+static struct
+{
+	XBAdpcmVoice voices[XB_ADPCM_VOICES];
+	XBAdpcmEncoder enc;
+	uint16_t age;
+	uint8_t queued;        // Buffer set in BAR, which plays next.
+	uint8_t playing;       // Buffer in MAR.
+	void *prev_isr;
+	XBAdpcmStats stats;
+} s_adpcm;
+
+static int16_t s_mix[XB_ADPCM_BLOCK_SAMPLES];
+
+#ifndef XB_ADPCM_HOST_SIM
+static uint8_t s_block[2][XB_ADPCM_BLOCK_BYTES];
+
+static inline volatile uint8_t *dmac8(uint16_t reg)
+{
+	return (volatile uint8_t *)(XB_DMAC_CH3 + reg);
+}
+
+static inline volatile uint16_t *dmac16(uint16_t reg)
+{
+	return (volatile uint16_t *)(XB_DMAC_CH3 + reg);
+}
+
+static inline volatile uint32_t *dmac32(uint16_t reg)
+{
+	return (volatile uint32_t *)(XB_DMAC_CH3 + reg);
+}
+
+static inline void ppi_set_bit(uint8_t bit, bool val)
+{
+	*(volatile uint8_t *)XB_PPI_CTRL = (bit << 1) | (val ? 1 : 0);
+}
+
+static inline void adpcm_command(uint8_t cmd)
+{
+	*(volatile uint8_t *)(XB_ADPCM_BASE + 1) = cmd;
+}
+#endif  // XB_ADPCM_HOST_SIM
+
+//
+// Mixing
+//
+
+// Moves a voice that has run past its end to the loop, or stops it.
+static void voice_wrap(XBAdpcmVoice *v)
+{
+	if (!v->loop || v->loop >= v->end)
+	{
+		v->pos = NULL;
+		return;
+	}
+	const uint32_t loop_len = v->end - v->loop;
+	uint32_t over = v->pos - v->end;
+	if (over >= loop_len) over %= loop_len;
+	v->pos = v->loop + over;
+}
+
+// Mixes one voice over the block. Returns false if it stopped before the end
+// of the block.
+static bool mix_voice(XBAdpcmVoice *v, bool first)
+{
+	int16_t *dst = s_mix;
+	uint16_t left = XB_ADPCM_BLOCK_SAMPLES;
+	while (left > 0)
+	{
+		// The last source sample read is at (frac + (count - 1) * pitch) / 256.
+		uint16_t count = left;
+		const uint32_t rem = (uint32_t)(v->end - v->pos) << 8;
+		const uint32_t frac = v->frac >> 8;
+		if (v->pitch && frac + (uint32_t)(left - 1) * v->pitch >= rem)
+		{
+			count = (rem - frac + v->pitch - 1) / v->pitch;
+		}
+		if (count > 0)
+		{
+			xb_adpcm_mix_span(dst, count, v, first);
+			dst += count;
+			left -= count;
+		}
+		if (left == 0) break;
+
+		voice_wrap(v);
+		if (!v->pos)
+		{
+			if (first) memset(dst, 0, left * sizeof(*dst));
+			return false;
+		}
+	}
+	if (v->pos >= v->end) voice_wrap(v);
+	return true;
+}
+
+// Mixes and encodes the next block into buf.
+static void mix_block(uint8_t *buf)
+{
+	uint16_t mixed = 0;
+	for (uint16_t i = 0; i < XB_ADPCM_VOICES; i++)
+	{
+		XBAdpcmVoice *v = &s_adpcm.voices[i];
+		if (!v->pos) continue;
+		mix_voice(v, mixed == 0);
+		mixed++;
+	}
+
+	s_adpcm.stats.blocks++;
+	s_adpcm.stats.voice_blocks += mixed;
+
+	if (mixed == 0)
+	{
+		if (s_adpcm.enc.predictor == 0 && s_adpcm.enc.index == 0)
+		{
+			memset(buf, ADPCM_SILENCE, XB_ADPCM_BLOCK_BYTES);
+			return;
+		}
+		// Let the encoder settle back to rest.
+		memset(s_mix, 0, sizeof(s_mix));
+	}
+	xb_adpcm_encode(s_mix, buf, XB_ADPCM_BLOCK_SAMPLES, &s_adpcm.enc);
+}
+
+#ifdef XB_ADPCM_HOST_SIM
+void xb_adpcm_sim_mix_block(uint8_t *buf)
+{
+	mix_block(buf);
+}
+#else
+//
+// DMA
+//
+
+static void dma_start(void)
+{
+	*dmac8(XB_DMAC_CSR) = 0xFF;
+	mix_block(s_block[0]);
+	mix_block(s_block[1]);
+	*dmac32(XB_DMAC_MAR) = (uint32_t)s_block[0];
+	*dmac16(XB_DMAC_MTC) = XB_ADPCM_BLOCK_BYTES;
+	*dmac32(XB_DMAC_BAR) = (uint32_t)s_block[1];
+	*dmac16(XB_DMAC_BTC) = XB_ADPCM_BLOCK_BYTES;
+	s_adpcm.playing = 0;
+	s_adpcm.queued = 1;
+	*dmac8(XB_DMAC_CCR) = XB_DMAC_CCR_STR | XB_DMAC_CCR_CNT | XB_DMAC_CCR_INT;
+}
+
+static void XB_ISR adpcm_isr(void)
+{
+	const uint16_t mtc_start = *dmac16(XB_DMAC_MTC);
+	const uint8_t csr = *dmac8(XB_DMAC_CSR);
+	*dmac8(XB_DMAC_CSR) = 0xFF;
+
+	if (csr & (XB_DMAC_CSR_COC | XB_DMAC_CSR_ERR))
+	{
+		// The DMAC ran out of blocks (or failed); start over.
+		s_adpcm.stats.underruns++;
+		dma_start();
+		return;
+	}
+
+	// The queued block has moved to MAR; refill the one that just finished and
+	// queue it behind.
+	const uint8_t done = s_adpcm.playing;
+	s_adpcm.playing = s_adpcm.queued;
+	mix_block(s_block[done]);
+	*dmac32(XB_DMAC_BAR) = (uint32_t)s_block[done];
+	*dmac16(XB_DMAC_BTC) = XB_ADPCM_BLOCK_BYTES;
+	*dmac8(XB_DMAC_CCR) = XB_DMAC_CCR_CNT | XB_DMAC_CCR_INT;
+	s_adpcm.queued = done;
+
+	// Mixing time, as bytes played meanwhile.
+	const uint16_t mtc_end = *dmac16(XB_DMAC_MTC);
+	const uint16_t bytes = (mtc_end <= mtc_start) ? (mtc_start - mtc_end)
+	                                              : XB_ADPCM_BLOCK_BYTES;
+	s_adpcm.stats.mix_bytes += bytes;
+	if (bytes > s_adpcm.stats.mix_bytes_max)
+	{
+		s_adpcm.stats.mix_bytes_max = bytes;
+	}
+}
+
+//
+// Interface
+//
+
+void *xb_adpcm_init(uint8_t rate)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	memset(&s_adpcm, 0, sizeof(s_adpcm));
+
+	// Stop anything in progress.
+	*dmac8(XB_DMAC_CCR) = XB_DMAC_CCR_SAB;
+	adpcm_command(ADPCM_CMD_STOP);
+
+	// Clock (OPM CT1), keeping the LFO wave and CT2.
+	uint8_t ct = g_xb_opm_reg_cache[OPM_REG_CONTROL] & 0x7F;
+	if (rate & 0x80) ct |= 0x80;
+	xb_opm_write(OPM_REG_CONTROL, ct);
+
+	// Divider (PPI port C bits 2-3), and output on both sides.
+	ppi_set_bit(2, rate & 0x01);
+	ppi_set_bit(3, rate & 0x02);
+	xb_adpcm_set_pan(XB_ADPCM_PAN_BOTH);
+
+	// Memory to the ADPCM data port, byte at a time, on its request.
+	*dmac8(XB_DMAC_CSR) = 0xFF;
+	*dmac8(XB_DMAC_DCR) = 0x80;
+	*dmac8(XB_DMAC_OCR) = 0x32;
+	*dmac8(XB_DMAC_SCR) = 0x04;
+	*dmac8(XB_DMAC_CPR) = 0x08;
+	*dmac8(XB_DMAC_MFC) = 0x05;
+	*dmac8(XB_DMAC_DFC) = 0x05;
+	*dmac8(XB_DMAC_BFC) = 0x05;
+	*dmac8(XB_DMAC_NIV) = XB_MFP_INT_DMAC_3_END;
+	*dmac8(XB_DMAC_EIV) = XB_MFP_INT_DMAC_3_ERROR;
+	*dmac32(XB_DMAC_DAR) = XB_ADPCM_BASE + 3;
+
+	s_adpcm.prev_isr = xb_mfp_set_interrupt(XB_MFP_INT_DMAC_3_END, adpcm_isr);
+	dma_start();
+	adpcm_command(ADPCM_CMD_PLAY);
+	xb_set_ipl(ipl);
+	return s_adpcm.prev_isr;
+}
+
+void xb_adpcm_shutdown(void)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	*dmac8(XB_DMAC_CCR) = XB_DMAC_CCR_SAB;
+	adpcm_command(ADPCM_CMD_STOP);
+	*dmac8(XB_DMAC_CSR) = 0xFF;
+	xb_mfp_set_interrupt(XB_MFP_INT_DMAC_3_END, s_adpcm.prev_isr);
+	xb_set_ipl(ipl);
+}
+
+void xb_adpcm_set_pan(uint8_t pan)
+{
+	// Port C bits 0 (left) and 1 (right) turn the output off when set.
+	ppi_set_bit(0, !(pan & XB_ADPCM_PAN_LEFT));
+	ppi_set_bit(1, !(pan & XB_ADPCM_PAN_RIGHT));
+}
+#endif  // XB_ADPCM_HOST_SIM
+
+int16_t xb_adpcm_play(int16_t voice, const int16_t *pcm, uint32_t samples,
+                      int32_t loop_start, uint16_t pitch, uint16_t volume)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	if (voice < 0 || voice >= XB_ADPCM_VOICES)
+	{
+		// A free voice, or else the oldest.
+		voice = 0;
+		for (int16_t i = 0; i < XB_ADPCM_VOICES; i++)
+		{
+			const XBAdpcmVoice *v = &s_adpcm.voices[i];
+			if (!v->pos)
+			{
+				voice = i;
+				break;
+			}
+			if ((int16_t)(v->age - s_adpcm.voices[voice].age) < 0) voice = i;
+		}
+	}
+
+	XBAdpcmVoice *v = &s_adpcm.voices[voice];
+	v->end = pcm + samples;
+	v->loop = (loop_start >= 0 && (uint32_t)loop_start < samples)
+	          ? pcm + loop_start : NULL;
+	v->frac = 0;
+	v->pitch = pitch;
+	v->volume = volume;
+	v->age = s_adpcm.age++;
+	v->pos = samples ? pcm : NULL;
+	xb_set_ipl(ipl);
+	return voice;
+}
+
+void xb_adpcm_stop(int16_t voice)
+{
+	if (voice < 0 || voice >= XB_ADPCM_VOICES) return;
+	s_adpcm.voices[voice].pos = NULL;
+}
+
+void xb_adpcm_set_pitch(int16_t voice, uint16_t pitch)
+{
+	if (voice < 0 || voice >= XB_ADPCM_VOICES) return;
+	s_adpcm.voices[voice].pitch = pitch;
+}
+
+void xb_adpcm_set_volume(int16_t voice, uint16_t volume)
+{
+	if (voice < 0 || voice >= XB_ADPCM_VOICES) return;
+	s_adpcm.voices[voice].volume = volume;
+}
+
+bool xb_adpcm_is_playing(int16_t voice)
+{
+	if (voice < 0 || voice >= XB_ADPCM_VOICES) return false;
+	return s_adpcm.voices[voice].pos != NULL;
+}
+
+void xb_adpcm_get_stats(XBAdpcmStats *out)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	*out = s_adpcm.stats;
+	memset(&s_adpcm.stats, 0, sizeof(s_adpcm.stats));
+	xb_set_ipl(ipl);
+}
@@ -0,0 +1,220 @@
+//
+// XBase ADPCM Sample Playback (adpcm)
+// (c) Michael Moffitt 2024
+//
+// Plays up to XB_ADPCM_VOICES 16-bit PCM samples at once through the MSM6258.
+// The voices are mixed and encoded to 4-bit ADPCM in blocks of
+// XB_ADPCM_BLOCK_SAMPLES, and the blocks are sent by DMAC channel 3 in
+// continue mode, alternating between two buffers. When the DMAC moves on to
+// the next buffer, its interrupt (XB_MFP_INT_DMAC_3_END) mixes the buffer that
+// just finished and queues it again.
+//
+// Samples are signed 16-bit, big-endian (as the 68000 stores them). Each voice
+// has a pitch, as an 8.8 fixed point step through the source per output sample
+// (0x100 plays the sample at the output rate), and a volume from 0 to
+// XB_ADPCM_VOLUME_MAX. Samples are reduced to 12 bits as they are mixed, and
+// the mix is clipped to the 12-bit range of the MSM6258.
+//
+// Approximate 68000 cycles per output sample (see adpcm_mix.a68):
+//   encoding:               ~150 (an idle block with no voices costs nothing)
+//   each voice, full volume: ~70
+//   each voice, with volume: ~160
+// A 10MHz 68000 has this many cycles per output sample, and mixing takes the
+// whole CPU at about this many voices (full volume / with volume):
+//   15.6kHz:  640 cycles,  7 / 3
+//   10.4kHz:  960 cycles, 11 / 5
+//    7.8kHz: 1280 cycles, 16 / 7
+//    5.2kHz: 1920 cycles, 25 / 11
+//    3.9kHz: 2560 cycles, 34 / 15
+// The program needs most of the CPU for itself, so plan on a fraction of
+// these. XB_ADPCM_VOICES defaults to 2: at 15.6kHz that is about 45% of the
+// CPU at full volume but nearly three quarters with volume, and at 10.4kHz
+// about 30% / 50%. Raise it only for lower rates.
+//
+// The interrupt measures how long mixing takes by the DMAC's progress through
+// the playing block, and xb_adpcm_get_stats() reports it, along with the
+// number of voices mixed, so the load per voice can be seen on hardware.
+//
+// The MSM6258 clock is selected with CT1 of OPM register $1B, which
+// xb_adpcm_init() sets while keeping the LFO wave setting in the OPM cache.
+//
+// When XB_ADPCM_HOST_SIM is defined, the DMA side is left out and blocks are
+// mixed on request with xb_adpcm_sim_mix_block(), for the host check in
+// tools/adpcm. That check runs a C copy of adpcm_mix.a68, not the assembly.
+#pragma once
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/memmap.h"
+#endif
+
+// Voices mixed at once; see the cycle counts above.
+#ifndef XB_ADPCM_VOICES
+#define XB_ADPCM_VOICES 2
+#endif
+
+// Output samples per DMA block; must be even. Mixing a block must take less
+// time than playing one.
+#ifndef XB_ADPCM_BLOCK_SAMPLES
+#define XB_ADPCM_BLOCK_SAMPLES 512
+#endif
+#define XB_ADPCM_BLOCK_BYTES (XB_ADPCM_BLOCK_SAMPLES / 2)
+
+#define XB_ADPCM_VOLUME_MAX 64
+#define XB_ADPCM_PITCH_1X 0x100
+
+// Sample rates. Bit 7 selects the 4MHz clock (OPM CT1), and bits 0-1 are the
+// divider (PPI port C bits 2-3).
+#define XB_ADPCM_RATE_3900  0x80  // 4MHz / 1024
+#define XB_ADPCM_RATE_5200  0x81  // 4MHz / 768
+#define XB_ADPCM_RATE_7800  0x00  // 8MHz / 1024
+#define XB_ADPCM_RATE_10400 0x01  // 8MHz / 768
+#define XB_ADPCM_RATE_15600 0x02  // 8MHz / 512
+
+// Output pan.
+#define XB_ADPCM_PAN_NONE  0
+#define XB_ADPCM_PAN_LEFT  1
+#define XB_ADPCM_PAN_RIGHT 2
+#define XB_ADPCM_PAN_BOTH  3
+
+// DMAC channel 3 registers.
+#define XB_DMAC_CH3 (XB_DMAC_BASE + 0xC0)
+#define XB_DMAC_CSR 0x00
+#define XB_DMAC_CER 0x01
+#define XB_DMAC_DCR 0x04
+#define XB_DMAC_OCR 0x05
+#define XB_DMAC_SCR 0x06
+#define XB_DMAC_CCR 0x07
+#define XB_DMAC_MTC 0x0A
+#define XB_DMAC_MAR 0x0C
+#define XB_DMAC_DAR 0x14
+#define XB_DMAC_BTC 0x1A
+#define XB_DMAC_BAR 0x1C
+#define XB_DMAC_NIV 0x25
+#define XB_DMAC_EIV 0x27
+#define XB_DMAC_MFC 0x29
+#define XB_DMAC_CPR 0x2D
+#define XB_DMAC_DFC 0x31
+#define XB_DMAC_BFC 0x39
+
+#define XB_DMAC_CSR_COC 0x80  // Channel operation complete
+#define XB_DMAC_CSR_BTC 0x40  // Block transfer complete (continue mode)
+#define XB_DMAC_CSR_ERR 0x10
+#define XB_DMAC_CSR_ACT 0x08
+#define XB_DMAC_CCR_STR 0x80  // Start
+#define XB_DMAC_CCR_CNT 0x40  // Continue with BAR / BTC
+#define XB_DMAC_CCR_SAB 0x10  // Abort
+#define XB_DMAC_CCR_INT 0x08  // Interrupt enable
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBAdpcmVoice.pos:	ds.l 1
+XBAdpcmVoice.end:	ds.l 1
+XBAdpcmVoice.loop:	ds.l 1
+XBAdpcmVoice.frac:	ds.w 1
+XBAdpcmVoice.pitch:	ds.w 1
+XBAdpcmVoice.volume:	ds.w 1
+XBAdpcmVoice.age:	ds.w 1
+XBAdpcmVoice.len:
+
+	.struct 0
+XBAdpcmEncoder.predictor:	ds.w 1
+XBAdpcmEncoder.index:		ds.w 1
+XBAdpcmEncoder.len:
+
+	.global	xb_adpcm_init
+	.global	xb_adpcm_shutdown
+	.global	xb_adpcm_set_pan
+	.global	xb_adpcm_play
+	.global	xb_adpcm_stop
+	.global	xb_adpcm_set_pitch
+	.global	xb_adpcm_set_volume
+	.global	xb_adpcm_is_playing
+	.global	xb_adpcm_get_stats
+	.global	xb_adpcm_mix_span
+	.global	xb_adpcm_encode
+#else
+typedef struct XBAdpcmVoice
+{
+	const int16_t *pos;   // Next source sample; NULL when the voice is off.
+	const int16_t *end;   // One past the last sample.
+	const int16_t *loop;  // Where to continue from the end, or NULL.
+	uint16_t frac;        // Position between samples, in the upper byte.
+	uint16_t pitch;       // 8.8 step per output sample.
+	uint16_t volume;      // 0 - XB_ADPCM_VOLUME_MAX
+	uint16_t age;         // Start order, for replacing the oldest voice.
+} XBAdpcmVoice;
+
+typedef struct XBAdpcmEncoder
+{
+	int16_t predictor;    // Last decoded 12-bit sample.
+	uint16_t index;       // Step table index, times two.
+} XBAdpcmEncoder;
+
+typedef struct XBAdpcmStats
+{
+	uint32_t blocks;          // Blocks mixed.
+	uint32_t voice_blocks;    // Sum of voices mixed per block.
+	uint32_t mix_bytes;       // Sum of DMA progress during mixing, in bytes.
+	uint16_t mix_bytes_max;   // Most DMA progress during one block's mixing.
+	uint16_t underruns;       // Times the DMAC ran out of data.
+} XBAdpcmStats;
+
+// Sets up DMAC channel 3 and the MSM6258, installs the interrupt handler and
+// starts output (silent until a voice plays). rate is XB_ADPCM_RATE_*.
+// Returns the previous DMAC channel 3 interrupt handler.
+void *xb_adpcm_init(uint8_t rate);
+
+// Stops output and restores the previous interrupt handler.
+void xb_adpcm_shutdown(void);
+
+// pan: XB_ADPCM_PAN_*
+void xb_adpcm_set_pan(uint8_t pan);
+
+// Starts a sample on a voice, or on a free voice (the oldest if all are busy)
+// when voice is -1. samples is the length, and loop_start is the sample to
+// continue from at the end, or -1 to stop.
+// Returns the voice used.
+int16_t xb_adpcm_play(int16_t voice, const int16_t *pcm, uint32_t samples,
+                      int32_t loop_start, uint16_t pitch, uint16_t volume);
+
+// These ignore a voice out of range (and xb_adpcm_is_playing() returns false).
+void xb_adpcm_stop(int16_t voice);
+void xb_adpcm_set_pitch(int16_t voice, uint16_t pitch);
+void xb_adpcm_set_volume(int16_t voice, uint16_t volume);
+bool xb_adpcm_is_playing(int16_t voice);
+
+// Copies the mixer statistics to out, and resets them.
+void xb_adpcm_get_stats(XBAdpcmStats *out);
+
+// Mixing load as parts per thousand of the block time, averaged over the
+// blocks in stats.
+static inline uint16_t xb_adpcm_get_load_permille(const XBAdpcmStats *stats);
+
+//
+// Mixer and encoder (adpcm_mix.a68)
+//
+
+// Mixes count output samples of a voice into dst, advancing the voice. If
+// first is true, dst is written rather than added to. The voice must not reach
+// its end within count samples.
+void xb_adpcm_mix_span(int16_t *dst, uint16_t count, XBAdpcmVoice *v,
+                       bool first);
+
+// Encodes count (even) 12-bit samples to ADPCM, two per byte, first sample in
+// the lower nibble.
+void xb_adpcm_encode(const int16_t *src, uint8_t *dst, uint16_t count,
+                     XBAdpcmEncoder *enc);
+
+#ifdef XB_ADPCM_HOST_SIM
+// Mixes and encodes the next block into buf, as the interrupt would.
+void xb_adpcm_sim_mix_block(uint8_t *buf);
+#endif  // XB_ADPCM_HOST_SIM
+
+static inline uint16_t xb_adpcm_get_load_permille(const XBAdpcmStats *stats)
+{
+	if (stats->blocks == 0) return 0;
+	return ((stats->mix_bytes / stats->blocks) * 1000) / XB_ADPCM_BLOCK_BYTES;
+}
+#endif
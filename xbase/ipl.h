@@ -19,4 +19,9 @@
 // Sets the IPL.
 // Returns the previous level so that it may be restored later.
 uint8_t xb_set_ipl(uint8_t ipl);
+
+#ifdef XB_IRQLAT
+// xb_set_ipl() without the timing done by util/irqlat.
+uint8_t xb_set_ipl_raw(uint8_t ipl);
+#endif  // XB_IRQLAT
 #endif
@@ -48,8 +48,33 @@ other controller variants exist:
 |___________________________________________|
 
 
-Support for Standard/Extended is complete. Support for CPSF-MD six-button
-controllers has not yet been implemented.
+Standard/Extended controllers are read in XB_JOY_MODE_STANDARD. Set a
+player's mode to XB_JOY_MODE_6BUTTON to read a CPSF-MD, or any Mega Drive
+style pad on the same wiring, where pin 8 drives the pad's select line.
+
+Each poll in six-button mode pulses pin 8 (PPI port C bit 4 or 5) four times,
+reading the pad on four of the eight phases: select high (directions, B, C),
+select low (A, START, and the Mega Drive ID with left and right both low), the
+third select low (all directions low on a six-button pad) and the select high
+after it (X, Y, Z and MODE, which is reported as SELECT). Mega Drive A / B / C
+map to XB_JOY_A / B / C. The pad type is detected on every poll and stored in
+the pad field, so any controller may be plugged in: a pad that does not give
+the Mega Drive ID is read as in standard mode (extended buttons included), and
+a three-button pad leaves X / Y / Z / SELECT clear.
+
+The select line rests high between polls. Six-button pads return to the first
+phase about 1.5ms after the last pulse, so poll no more than once a frame.
+Interrupts are masked for the pulse sequence, so a handler cannot stretch it
+past that time; the IPL is raised for about 20us per six-button port.
+
+Cost per port, counted from the instruction timings (68000 cycles with no
+wait states, excluding the few instructions xb_joy_poll() shares):
+  XB_JOY_MODE_STANDARD: about 200
+  XB_JOY_MODE_6BUTTON:  about 670 (six-button pad), 560 (three-button),
+                        530 (other pads)
+At 10MHz, six-button mode adds roughly 47us per port to the input budget.
+Wait states on the PPI add a few cycles to each of the eight accesses; wrap
+xb_joy_poll() in a profiler zone (util/prof) to measure it on hardware.
 
 As the extended controller implements the start button with a left+right macro,
 and select with an up+down macro, the direction inputs will be filtered out
@@ -105,6 +130,11 @@ The default mode is XB_JOY_MODE_STANDARD.
 #define XB_JOY_MODE_STANDARD 0x00
 #define XB_JOY_MODE_6BUTTON  0x01
 
+// Pad types detected in XB_JOY_MODE_6BUTTON.
+#define XB_JOY_PAD_STANDARD  0x00  // Standard / extended, or nothing plugged in.
+#define XB_JOY_PAD_MD3       0x01  // Three-button Mega Drive style pad.
+#define XB_JOY_PAD_MD6       0x02  // Six-button pad (CPSF-MD).
+
 //
 // Player state struct. Set mode to XB_JOY_MODE_* as desired, and test for
 // inputs with bitwise operations on any fields after calling xb_joy_poll().
@@ -116,6 +146,7 @@ XBJoyState.now:		ds.w 1
 XBJoyState.prev:	ds.w 1
 XBJoyState.pos:		ds.w 1
 XBJoyState.neg:		ds.w 1
+XBJoyState.pad:		ds.w 1
 XBJoyState.len:
 
 	.extern	g_xb_joystate
@@ -127,6 +158,7 @@ typedef struct XBJoyState
 	uint16_t prev;  // The previous sampling period's data.
 	uint16_t pos;   // Newly pressed buttons.
 	uint16_t neg;   // Newly released buttons.
+	uint16_t pad;   // XB_JOY_PAD_*, as detected in six-button mode.
 } XBJoyState;
 
 extern XBJoyState g_xb_joystate[XB_JOY_COUNT];
@@ -1,5 +1,12 @@
 #include "xbase/keys.h"
 #include "macro.h"
+#include "xbase/util/vbl_wait.h"
+
+#ifdef XB_KEYS_USART
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+#include "xbase/util/ring.h"
+#endif  // XB_KEYS_USART
 
 #include <string.h>
 #include <iocs.h>
@@ -7,6 +14,7 @@
 #define XB_KEYS_DEFAULT_REPEAT_DELAY 12
 #define XB_KEYS_DEFAULT_REPEAT_RATE 1
 #define XB_KEYS_KEY_EVENT_QUEUE_DEPTH 32
+#define XB_KEYS_USART_QUEUE_DEPTH 64  // Must be a power of two.
 
 typedef struct XBKeys
 {
@@ -25,13 +33,34 @@ typedef struct XBKeys
 	int16_t repeat_delay;   // Delay setting
 	int16_t repeat_period;  // Repeat rate setting
 
-	// Key sensitivity list
-	XBKey sense_list[XB_KEY_INVALID];
-	uint16_t sense_list_size;
+	// Keys to generate events for, in the same format as key_bits
+	uint8_t sense_bits[15];
+
+	// Key name for each key number (group * 8 + bit), or XB_KEY_INVALID
+	uint8_t code_keys[15 * 8];
 } XBKeys;
 
 static XBKeys s_keys;
 
+#ifdef XB_KEYS_USART
+// A make / break code from the keyboard.
+typedef struct XBKeyCode
+{
+	uint32_t frame;  // xb_vbl_get_frame_count() when it arrived.
+	uint8_t code;    // Key number, with bit 7 set for a break.
+} XBKeyCode;
+
+static struct
+{
+	uint8_t key_bits[15];    // Kept current by the interrupt handler.
+	volatile bool resync;    // Codes were dropped; compare matrices instead.
+	XBRing ring;
+	XBKeyCode codes[XB_KEYS_USART_QUEUE_DEPTH];
+	void *prev_isr;
+	bool installed;
+} s_usart;
+#endif  // XB_KEYS_USART
+
 //
 // Group and mask data for key enum values.
 //
@@ -199,6 +228,69 @@ static inline bool key_negedge(XBKey key)
 	return prev && !now;
 }
 
+// The key number is the bitsns() group times eight plus the bit number.
+static inline uint8_t key_code(XBKey key)
+{
+	const XBKeyID *id = &kkey_table[key];
+	return (id->group << 3) | __builtin_ctz(id->mask);
+}
+
+//
+// USART receive interrupt
+//
+
+#ifdef XB_KEYS_USART
+
+static void XB_ISR keys_usart_isr(void)
+{
+	const uint8_t data = *(volatile uint8_t *)XB_MFP_UDR;
+	const uint8_t group = (data & 0x7F) >> 3;
+	if (group >= XB_ARRAYSIZE(s_usart.key_bits)) return;
+	const uint8_t mask = 1 << (data & 0x07);
+	if (data & 0x80)
+	{
+		s_usart.key_bits[group] &= ~mask;
+	}
+	else
+	{
+		// Held keys are repeated by the keyboard; drop those.
+		if (s_usart.key_bits[group] & mask) return;
+		s_usart.key_bits[group] |= mask;
+	}
+
+	XBKeyCode *c = xb_ring_write_ptr(&s_usart.ring);
+	if (!c)
+	{
+		s_usart.resync = true;
+		return;
+	}
+	c->frame = xb_vbl_get_frame_count();
+	c->code = data;
+	xb_ring_write_done(&s_usart.ring);
+}
+
+static void keys_usart_install(void)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	if (!s_usart.installed)
+	{
+		// Start from the IOCS matrix, so keys already held are not lost. The
+		// first poll generates their events as the default path would.
+		for (uint16_t i = 0; i < XB_ARRAYSIZE(s_usart.key_bits); i++)
+		{
+			s_usart.key_bits[i] = _iocs_bitsns(i);
+		}
+		xb_ring_init(&s_usart.ring, s_usart.codes,
+		             XB_ARRAYSIZE(s_usart.codes), sizeof(s_usart.codes[0]));
+		s_usart.prev_isr = xb_mfp_set_interrupt(
+		    XB_MFP_INT_KEY_SERIAL_IN_BUFFER_FULL, keys_usart_isr);
+		s_usart.installed = true;
+	}
+	s_usart.resync = true;
+	xb_set_ipl(ipl);
+}
+#endif  // XB_KEYS_USART
+
 //
 // Initialization and Configuration
 //
@@ -209,25 +301,43 @@ void xb_keys_init(const XBKey *sense_list)
 	xb_keys_set_repeat(-1, -1);
 	s_keys.repeat_key = XB_KEY_INVALID;
 
+	memset(s_keys.code_keys, XB_KEY_INVALID, sizeof(s_keys.code_keys));
+	for (XBKey i = 0; i < XB_KEY_INVALID; i++)
+	{
+		s_keys.code_keys[key_code(i)] = i;
+	}
+
 	if (sense_list == NULL)
 	{
 		for (XBKey i = 0; i < XB_KEY_INVALID; i++)
 		{
-			s_keys.sense_list[i] = i;
+			s_keys.sense_bits[kkey_table[i].group] |= kkey_table[i].mask;
 		}
-		s_keys.sense_list_size = XB_ARRAYSIZE(s_keys.sense_list);
 	}
 	else
 	{
-		uint16_t i = 0;
-		while (sense_list[i] != XB_KEY_INVALID &&
-		       i < XB_ARRAYSIZE(s_keys.sense_list))
+		for (uint16_t i = 0; sense_list[i] != XB_KEY_INVALID; i++)
 		{
-			s_keys.sense_list[i] = sense_list[i];
-			i++;
+			const XBKeyID *id = &kkey_table[sense_list[i]];
+			s_keys.sense_bits[id->group] |= id->mask;
 		}
-		s_keys.sense_list_size = i;
 	}
+
+#ifdef XB_KEYS_USART
+	keys_usart_install();
+#endif  // XB_KEYS_USART
+}
+
+void xb_keys_shutdown(void)
+{
+#ifdef XB_KEYS_USART
+	if (!s_usart.installed) return;
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	xb_mfp_set_interrupt(XB_MFP_INT_KEY_SERIAL_IN_BUFFER_FULL,
+	                     s_usart.prev_isr);
+	s_usart.installed = false;
+	xb_set_ipl(ipl);
+#endif  // XB_KEYS_USART
 }
 
 void xb_keys_set_repeat(int16_t delay, int16_t rate)
@@ -238,7 +348,8 @@ void xb_keys_set_repeat(int16_t delay, int16_t rate)
 	s_keys.repeat_period = rate;
 }
 
-static inline void event_push(XBKey key, bool repeat, bool key_up)
+static inline void event_push(XBKey key, bool repeat, bool key_up,
+                              uint32_t frame)
 {
 	const uint16_t next_w = (s_keys.key_w + 1) % XB_ARRAYSIZE(s_keys.key_events);
 	if (next_w == s_keys.key_r) return;  // Queue full.
@@ -251,61 +362,143 @@ static inline void event_push(XBKey key, bool repeat, bool key_up)
 	if (key_is_held(XB_KEY_CTRL)) ev->modifiers |= XB_KEY_MOD_CTRL;
 	if (key_up) ev->modifiers |= XB_KEY_MOD_KEY_UP;
 	else if (repeat) ev->modifiers |= XB_KEY_MOD_IS_REPEAT;
+	ev->frame = frame;
 	// Move the write index forth
 	s_keys.key_w = next_w;
 }
 
+static inline void key_change(XBKey key, bool key_up, uint32_t frame)
+{
+	event_push(key, /*repeat=*/false, key_up, frame);
+	// Freshly pressed key resets the key repeat logic
+	if (!key_up && s_keys.repeat_key != key)
+	{
+		s_keys.repeat_key = key;
+		s_keys.repeat_cnt = -s_keys.repeat_delay;
+	}
+}
+
+// Generates events for sensed keys that differ from the previous poll, a group
+// of eight at a time.
+static void scan_changes(uint32_t frame)
+{
+	for (uint16_t i = 0; i < XB_ARRAYSIZE(s_keys.key_bits); i++)
+	{
+		uint8_t changed = (s_keys.key_bits[i] ^ s_keys.key_bits_prev[i]) &
+		                  s_keys.sense_bits[i];
+		if (!changed) continue;
+		const uint8_t *keys = &s_keys.code_keys[i << 3];
+		for (uint16_t bit = 0; changed; bit++, changed >>= 1)
+		{
+			if (!(changed & 1)) continue;
+			const bool key_up = !(s_keys.key_bits[i] & (1 << bit));
+			key_change(keys[bit], key_up, frame);
+		}
+	}
+}
+
+#ifdef XB_KEYS_USART
+// Replays the codes queued by the interrupt handler. If any were dropped, the
+// matrix is copied and compared instead.
+static void usart_poll(uint32_t frame)
+{
+	if (s_usart.resync)
+	{
+		const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+		memcpy(s_keys.key_bits, s_usart.key_bits, sizeof(s_keys.key_bits));
+		s_usart.ring.tail = s_usart.ring.head;
+		s_usart.resync = false;
+		xb_set_ipl(ipl);
+		scan_changes(frame);
+		return;
+	}
+
+	const XBKeyCode *c;
+	while ((c = xb_ring_read_ptr(&s_usart.ring)))
+	{
+		const uint8_t code = c->code & 0x7F;
+		const uint8_t group = code >> 3;
+		const uint8_t mask = 1 << (code & 0x07);
+		const bool key_up = c->code & 0x80;
+		// Applied first, so the event's modifiers include itself.
+		if (key_up) s_keys.key_bits[group] &= ~mask;
+		else s_keys.key_bits[group] |= mask;
+		if (s_keys.sense_bits[group] & mask)
+		{
+			key_change(s_keys.code_keys[code], key_up, c->frame);
+		}
+		xb_ring_read_done(&s_usart.ring);
+	}
+}
+#endif  // XB_KEYS_USART
+
+static void key_repeat(uint32_t frame)
+{
+	if (s_keys.repeat_key == XB_KEY_INVALID) return;
+	if (key_is_held(s_keys.repeat_key))
+	{
+		s_keys.repeat_cnt++;
+		if (s_keys.repeat_cnt >= s_keys.repeat_period)
+		{
+			s_keys.repeat_cnt = 0;
+			event_push(s_keys.repeat_key,
+			           /*repeat=*/true,
+			           /*key_up=*/false,
+			           frame);
+		}
+	}
+	else
+	{
+		s_keys.repeat_key = XB_KEY_INVALID;
+	}
+}
+
 //
 // Main Interface
 //
 
 void xb_keys_poll(void)
 {
+	const uint32_t frame = xb_vbl_get_frame_count();
+
 	// Update key matrix bitfields
 	memcpy(s_keys.key_bits_prev, s_keys.key_bits, sizeof(s_keys.key_bits));
+#ifdef XB_KEYS_USART
+	usart_poll(frame);
+#else
+	// Most polls change nothing, and skip the scan.
+	uint8_t changed = 0;
 	for (uint16_t i = 0; i < XB_ARRAYSIZE(s_keys.key_bits); i++)
 	{
 		s_keys.key_bits[i] = _iocs_bitsns(i);
+		changed |= s_keys.key_bits[i] ^ s_keys.key_bits_prev[i];
 	}
+	if (changed) scan_changes(frame);
+#endif  // XB_KEYS_USART
 
-	// Generate events
-	for (uint16_t i = 0; i < s_keys.sense_list_size; i++)
-	{
-		const XBKey key = s_keys.sense_list[i];
-		const bool posedge = key_posedge(key);
-		const bool negedge = key_negedge(key);
-		if (!posedge && !negedge) continue;
-		event_push(key,
-		           /*repeat=*/false,
-		           /*key_up=*/negedge);
-		// Freshly pressed key resets the key repeat logic
-		if (posedge && s_keys.repeat_key != key)
-		{
-			s_keys.repeat_key = key;
-			s_keys.repeat_cnt = -s_keys.repeat_delay;
-		}
-	}
+	key_repeat(frame);
+}
 
+void xb_keys_poll_matrix(const uint8_t *bits, uint32_t frame)
+{
+	memcpy(s_keys.key_bits_prev, s_keys.key_bits, sizeof(s_keys.key_bits));
+	memcpy(s_keys.key_bits, bits, sizeof(s_keys.key_bits));
+	scan_changes(frame);
+	key_repeat(frame);
+}
 
-	// Key repeat logic
-	if (s_keys.repeat_key != XB_KEY_INVALID)
+void xb_keys_read_matrix(uint8_t *out)
+{
+#ifdef XB_KEYS_USART
+	// Called from the vblank interrupt, which the USART interrupt does not
+	// preempt (both come through the MFP at the same level).
+	memcpy(out, s_usart.key_bits, sizeof(s_usart.key_bits));
+#else
+	for (uint16_t i = 0; i < XB_ARRAYSIZE(s_keys.key_bits); i++)
 	{
-		if (key_is_held(s_keys.repeat_key))
-		{
-			s_keys.repeat_cnt++;
-			if (s_keys.repeat_cnt >= s_keys.repeat_period)
-			{
-				s_keys.repeat_cnt = 0;
-				event_push(s_keys.repeat_key,
-				           /*repeat=*/true,
-				           /*key_up=*/false);
-			}
-		}
-		else
-		{
-			s_keys.repeat_key = XB_KEY_INVALID;
-		}
+		out[i] = _iocs_bitsns(i);
 	}
+#endif  // XB_KEYS_USART
 }
 
 bool xb_keys_event_pop(XBKeyEvent *out)
@@ -281,12 +281,14 @@ typedef enum XBKey
 	.struct 0
 XBKeyEvent.name:		ds.w 1
 XBKeyEvent.modifiers:	ds.w 1
+XBKeyEvent.frame:		ds.l 1
 XBKeyEvent.len:
 #else
 typedef struct XBKeyEvent
 {
 	uint16_t name;
 	uint16_t modifiers;
+	uint32_t frame;  // xb_vbl_get_frame_count() when the key changed.
 } XBKeyEvent;
 #endif
 
@@ -294,11 +296,32 @@ typedef struct XBKeyEvent
 // Initialization and Configuration
 //
 
+// By default, xb_keys_poll() reads the key matrix kept by IOCS, with one
+// _iocs_bitsns() call per group, and finds changes by comparing it against the
+// previous poll. Events carry the frame of the poll that found them.
+//
+// With XB_KEYS_USART defined, the keyboard's make / break codes are instead
+// taken straight from the MFP USART receive interrupt, which keeps its own key
+// matrix and queues each change with the frame it arrived in. xb_keys_poll()
+// only replays the queued changes, and the order of changes within a frame is
+// kept, so a key pressed and released between polls still produces both
+// events. The keyboard's own key repeat is ignored in favor of the repeat set
+// with xb_keys_set_repeat().
+// While this is active, IOCS receives no key input at all: its key buffer,
+// _iocs_bitsns() and BREAK / CTRL+C checks stop working until
+// xb_keys_shutdown() restores its handler. If the queue fills up, the next
+// poll generates events from the change in the matrix instead, as the default
+// path does. Frame numbers come from xb_vbl_get_frame_count(), so they only
+// count with xb_vbl_wait_init() done.
+
 #ifdef __ASSEMBLER__
 
 	.global	xb_keys_init
+	.global	xb_keys_shutdown
 	.global	xb_keys_set_repeat
 	.global	xb_keys_poll
+	.global	xb_keys_poll_matrix
+	.global	xb_keys_read_matrix
 	.global	xb_keys_event_pop
 	.global	xb_key_on
 	.global	xb_key_down
@@ -311,6 +334,10 @@ typedef struct XBKeyEvent
 // Passing in NULL will default to all keys being scanned.
 void xb_keys_init(const XBKey *sense_list);
 
+// Puts back the IOCS keyboard handler replaced with XB_KEYS_USART. Does
+// nothing otherwise.
+void xb_keys_shutdown(void);
+
 // Set the key repeat delay and rate in terms of poll() periods.
 // Pass a number <= 0 to reset to the default value.
 void xb_keys_set_repeat(int16_t delay, int16_t rate);
@@ -323,6 +350,15 @@ void xb_keys_set_repeat(int16_t delay, int16_t rate);
 // It is recommended that this is executed at the start of your main loop.
 void xb_keys_poll(void);
 
+// Like xb_keys_poll(), but takes the key matrix from bits (15 bytes, in
+// _iocs_bitsns() format) instead of reading it, and stamps events with frame.
+// For input sampled elsewhere (see util/insample) or played back.
+void xb_keys_poll_matrix(const uint8_t *bits, uint32_t frame);
+
+// Copies the current key matrix (15 bytes) to out. May be called from an
+// interrupt handler.
+void xb_keys_read_matrix(uint8_t *out);
+
 // Returns true if a previously pending key event was written to out.
 // Otherwise, returns false.
 bool xb_keys_event_pop(XBKeyEvent *out);
@@ -18,3 +18,7 @@
     ({ __typeof__ (a) _a = (a); \
        __typeof__ (b) _b = (b); \
        _a < _b ? _a : _b; })
+
+// Keeps the compiler from moving memory accesses across this point, e.g. to
+// finish writing data before publishing it to an interrupt handler.
+#define XB_BARRIER() __asm__ volatile("" ::: "memory")
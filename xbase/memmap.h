@@ -9,6 +9,7 @@
 #define XB_VIDCON_R0           0xE82400
 #define XB_VIDCON_R1           0xE82500
 #define XB_VIDCON_R2           0xE82600
+#define XB_DMAC_BASE           0xE84000
 #define XB_MFP_BASE            0xE88000
 
 #define XB_PCG_SPR_TABLE       0xEB0000
@@ -26,4 +27,7 @@
 #define XB_PCG_MODE            0xEB0810
 
 #define XB_OPM_BASE            0xE90000
+#define XB_ADPCM_BASE          0xE92000
 #define XB_JOY_BASE            0xE9A001
+#define XB_PPI_PORT_C          0xE9A005
+#define XB_PPI_CTRL            0xE9A007
@@ -1,6 +1,8 @@
 #include "xbase/mfp.h"
+#include "xbase/ipl.h"
 #include "xbase/memmap.h"
 #include <iocs.h>
+#include <stddef.h>
 
 // Struct representing MFP registers.
 typedef struct XBMFP
@@ -43,6 +45,98 @@ void *xb_mfp_set_interrupt(uint16_t vector, void (*interrupt_handler)(void))
 	return _iocs_b_intvcs(vector, interrupt_handler);
 }
 
+//
+// Direct vector installation
+//
+
+typedef struct XBMfpChainSlot
+{
+	bool (*handler)(void);  // NULL when the slot is free.
+	void *prev;
+} XBMfpChainSlot;
+
+// mfp_chain.a68
+extern XBMfpChainSlot g_xb_mfp_chain_slots[XB_MFP_CHAIN_COUNT];
+extern void *g_xb_mfp_chain_tramps[XB_MFP_CHAIN_COUNT];
+
+typedef struct XBMfpSavedVector
+{
+	uint16_t vector;  // 0 when unused.
+	void *orig;
+} XBMfpSavedVector;
+
+static XBMfpSavedVector s_saved[XB_MFP_SAVED_VECTORS];
+
+static inline void **vector_addr(uint16_t vector)
+{
+	return (void **)((uint32_t)vector * 4);
+}
+
+// Records the original handler for a vector. Returns false if there is no
+// room. The IPL must be raised.
+static bool save_vector(uint16_t vector)
+{
+	XBMfpSavedVector *free_entry = NULL;
+	for (uint16_t i = 0; i < XB_MFP_SAVED_VECTORS; i++)
+	{
+		if (s_saved[i].vector == vector) return true;
+		if (!free_entry && s_saved[i].vector == 0) free_entry = &s_saved[i];
+	}
+	if (!free_entry) return false;
+	free_entry->vector = vector;
+	free_entry->orig = *vector_addr(vector);
+	return true;
+}
+
+void *xb_mfp_set_vector(uint16_t vector, void (*interrupt_handler)(void))
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	void *prev = NULL;
+	if (save_vector(vector))
+	{
+		prev = *vector_addr(vector);
+		*vector_addr(vector) = (void *)interrupt_handler;
+	}
+	xb_set_ipl(ipl);
+	return prev;
+}
+
+bool xb_mfp_chain_vector(uint16_t vector, bool (*handler)(void))
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	bool ret = false;
+	for (uint16_t i = 0; i < XB_MFP_CHAIN_COUNT; i++)
+	{
+		XBMfpChainSlot *slot = &g_xb_mfp_chain_slots[i];
+		if (slot->handler) continue;
+		if (!save_vector(vector)) break;
+		slot->handler = handler;
+		slot->prev = *vector_addr(vector);
+		*vector_addr(vector) = g_xb_mfp_chain_tramps[i];
+		ret = true;
+		break;
+	}
+	xb_set_ipl(ipl);
+	return ret;
+}
+
+void xb_mfp_restore_vectors(void)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	for (uint16_t i = 0; i < XB_MFP_SAVED_VECTORS; i++)
+	{
+		XBMfpSavedVector *saved = &s_saved[i];
+		if (saved->vector == 0) continue;
+		*vector_addr(saved->vector) = saved->orig;
+		saved->vector = 0;
+	}
+	for (uint16_t i = 0; i < XB_MFP_CHAIN_COUNT; i++)
+	{
+		g_xb_mfp_chain_slots[i].handler = NULL;
+	}
+	xb_set_ipl(ipl);
+}
+
 void xb_mfp_set_interrupt_enable(uint16_t vector, bool enabled)
 {
 	if (vector >= XB_MFP_INT_TIMER_B && vector <= XB_MFP_INT_HSYNC)
@@ -78,3 +172,118 @@ void xb_mfp_set_interrupt_enable(uint16_t vector, bool enabled)
 		}
 	}
 }
+
+void xb_mfp_set_timer(uint16_t timer, uint8_t prescale, uint8_t count)
+{
+	// The data register is written while the timer is stopped so that the
+	// counter is loaded as well.
+	switch (timer)
+	{
+		case XB_MFP_TIMER_A:
+			s_mfp->tacr = XB_MFP_TIMER_STOP;
+			s_mfp->tadr = count;
+			s_mfp->tacr = prescale;
+			break;
+		case XB_MFP_TIMER_B:
+			s_mfp->tbcr = XB_MFP_TIMER_STOP;
+			s_mfp->tbdr = count;
+			s_mfp->tbcr = prescale;
+			break;
+		case XB_MFP_TIMER_C:
+			s_mfp->tcdcr = s_mfp->tcdcr & 0x07;
+			s_mfp->tcdr = count;
+			s_mfp->tcdcr = (s_mfp->tcdcr & 0x07) | ((prescale & 0x07) << 4);
+			break;
+		case XB_MFP_TIMER_D:
+			s_mfp->tcdcr = s_mfp->tcdcr & 0x70;
+			s_mfp->tddr = count;
+			s_mfp->tcdcr = (s_mfp->tcdcr & 0x70) | (prescale & 0x07);
+			break;
+	}
+}
+
+static volatile uint16_t *timer_data(uint16_t timer)
+{
+	switch (timer)
+	{
+		default:
+		case XB_MFP_TIMER_A:
+			return &s_mfp->tadr;
+		case XB_MFP_TIMER_B:
+			return &s_mfp->tbdr;
+		case XB_MFP_TIMER_C:
+			return &s_mfp->tcdr;
+		case XB_MFP_TIMER_D:
+			return &s_mfp->tddr;
+	}
+}
+
+// A count of 0 is 256.
+static inline uint16_t timer_count(uint8_t count)
+{
+	return count ? count : 256;
+}
+
+void xb_mfp_save_timer(uint16_t timer, XBMfpTimerState *out)
+{
+	volatile uint16_t *data = timer_data(timer);
+	switch (timer)
+	{
+		case XB_MFP_TIMER_A:
+			out->control = s_mfp->tacr & 0x0F;
+			break;
+		case XB_MFP_TIMER_B:
+			out->control = s_mfp->tbcr & 0x0F;
+			break;
+		case XB_MFP_TIMER_C:
+			out->control = (s_mfp->tcdcr >> 4) & 0x07;
+			break;
+		case XB_MFP_TIMER_D:
+			out->control = s_mfp->tcdcr & 0x07;
+			break;
+	}
+	out->count = *data;
+	// Only a running timer in delay mode reloads.
+	if (out->control == XB_MFP_TIMER_STOP || out->control > 0x07) return;
+
+	// Wait for the count to run nearly out, then watch it wrap with interrupts
+	// masked, so that the first value after the wrap is not missed.
+	while (timer_count(*data) > 2) {}
+	// A count that never rises is a reload of 1; the read limit is well over
+	// two counts at DIV_200.
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	out->count = *data;
+	uint16_t prev = timer_count(out->count);
+	for (uint16_t i = 0; i < 1000; i++)
+	{
+		const uint8_t now = *data;
+		if (timer_count(now) > prev)
+		{
+			out->count = now;
+			break;
+		}
+		prev = timer_count(now);
+	}
+	xb_set_ipl(ipl);
+}
+
+void xb_mfp_restore_timer(uint16_t timer, const XBMfpTimerState *state)
+{
+	xb_mfp_set_timer(timer, state->control, state->count);
+}
+
+uint8_t xb_mfp_get_timer_count(uint16_t timer)
+{
+	switch (timer)
+	{
+		case XB_MFP_TIMER_A:
+			return s_mfp->tadr;
+		case XB_MFP_TIMER_B:
+			return s_mfp->tbdr;
+		case XB_MFP_TIMER_C:
+			return s_mfp->tcdr;
+		case XB_MFP_TIMER_D:
+			return s_mfp->tddr;
+	}
+	return 0;
+}
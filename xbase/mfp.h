@@ -8,6 +8,7 @@
 #ifndef __ASSEMBLER__
 #include <stdbool.h>
 #include <stdint.h>
+#include "xbase/memmap.h"
 #endif
 
 // The following interrupt sources may be enabled and disabled.
@@ -88,7 +89,61 @@
 #define XB_MFP_MASK_VDISP                   0x40
 #define XB_MFP_MASK_RTC_CLOCK               0x80
 
-#ifndef __ASSEMBLER__
+// MFP timers. Timer B clocks the keyboard serial link, and Timers C and D are
+// used by Human68k (cursor / FDD and background processing). Timer A is only
+// used by IOCS _VDISPST (which counts vertical blanks with it), so it is free
+// unless that is in use.
+#define XB_MFP_TIMER_A 0
+#define XB_MFP_TIMER_B 1
+#define XB_MFP_TIMER_C 2
+#define XB_MFP_TIMER_D 3
+
+// Timer prescaler settings for delay mode. The MFP is clocked at 4MHz.
+#define XB_MFP_TIMER_STOP    0x00
+#define XB_MFP_TIMER_DIV_4   0x01  // 1.0us per count
+#define XB_MFP_TIMER_DIV_10  0x02  // 2.5us
+#define XB_MFP_TIMER_DIV_16  0x03  // 4.0us
+#define XB_MFP_TIMER_DIV_50  0x04  // 12.5us
+#define XB_MFP_TIMER_DIV_64  0x05  // 16.0us
+#define XB_MFP_TIMER_DIV_100 0x06  // 25.0us
+#define XB_MFP_TIMER_DIV_200 0x07  // 50.0us
+
+// Timer A control and data registers, for code that needs to start and stop
+// the timer quickly (e.g. from an ISR), and the other data registers, for
+// reading counts directly.
+#define XB_MFP_TACR (XB_MFP_BASE + 0x19)
+#define XB_MFP_TADR (XB_MFP_BASE + 0x1F)
+#define XB_MFP_TCDR (XB_MFP_BASE + 0x23)
+#define XB_MFP_TDDR (XB_MFP_BASE + 0x25)
+
+// Interrupt pending registers; bits as in XB_MFP_MASK_*.
+#define XB_MFP_IPRA (XB_MFP_BASE + 0x0B)
+#define XB_MFP_IPRB (XB_MFP_BASE + 0x0D)
+
+// USART receiver status and data registers (the keyboard link).
+#define XB_MFP_RSR (XB_MFP_BASE + 0x2B)
+#define XB_MFP_UDR (XB_MFP_BASE + 0x2F)
+
+// Vectors that xb_mfp_set_vector() can change, and restore afterwards.
+#define XB_MFP_SAVED_VECTORS 16
+
+// Chained handlers that may be installed at once (up to 8).
+#ifndef XB_MFP_CHAIN_COUNT
+#define XB_MFP_CHAIN_COUNT 4
+#endif
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBMfpChainSlot.handler:	ds.l 1
+XBMfpChainSlot.prev:	ds.l 1
+XBMfpChainSlot.len:
+
+	.global	g_xb_mfp_chain_slots
+	.global	g_xb_mfp_chain_tramps
+	.global	xb_mfp_set_vector
+	.global	xb_mfp_chain_vector
+	.global	xb_mfp_restore_vectors
+#else
 
 // Read from the MFP's general purpose data register. AND the result with
 // XBMFPGPDR BITVAL values to test bits.
@@ -102,7 +157,72 @@ uint8_t xb_mfp_read_gpdr(void);
 // Returns a pointer to whatever was previously registered.
 void *xb_mfp_set_interrupt(uint16_t vector, void (*interrupt_handler)(void));
 
+// Writes a handler to the exception vector table directly, instead of going
+// through IOCS as xb_mfp_set_interrupt() does. The original vector is kept
+// the first time one is changed, so xb_mfp_restore_vectors() can put it back.
+// Like xb_mfp_set_interrupt(), the handler must return with rte.
+// Returns the previous handler, or NULL (changing nothing) if
+// XB_MFP_SAVED_VECTORS different vectors have already been changed.
+void *xb_mfp_set_vector(uint16_t vector, void (*interrupt_handler)(void));
+
+// Installs a regular C function in front of the current handler for a vector.
+// On each interrupt the function is called, and if it returns true, the
+// previous handler runs as well; otherwise the interrupt ends there. The
+// trampoline (mfp_chain.a68) saves only the registers C code may change.
+// Returns false if all XB_MFP_CHAIN_COUNT chains are in use, or the vector
+// could not be saved.
+bool xb_mfp_chain_vector(uint16_t vector, bool (*handler)(void));
+
+// Puts back every vector changed with xb_mfp_set_vector() or
+// xb_mfp_chain_vector(), and frees the chains.
+void xb_mfp_restore_vectors(void);
+
+// Estimated latency, in 68000 cycles from the start of interrupt acknowledge
+// to the first instruction of the handler, counted from the instruction
+// timings with no wait states (util/irqlat measures it on hardware):
+//   xb_mfp_set_interrupt() or xb_mfp_set_vector(): 44 to reach the vector's
+//     target in either case; IOCS writes the same table. The IOCS path only
+//     costs more to register (a trap and the IOCS dispatch).
+//   xb_mfp_set_vector() with an XB_ISR function: 44, plus the registers the
+//     compiler chooses to save in its prologue.
+//   xb_mfp_chain_vector(): 44 + 8 (subq) + 56 (movem) + 12 (lea) + 10 (bra)
+//     + 12 (push) + 16 (movea) + 16 (jsr) = 174, then about 120 more to
+//     return, plus about 70 to enter the previous handler when chaining.
+// Add the remainder of the instruction being executed (up to ~160 for a long
+// divide, more with movem) and any time with the IPL raised. These have not
+// been checked against a real machine; use xb_irqlat_watch() to see the
+// figures for a given program.
+
 // Enable or disable interrupt generation for a vector.
 void xb_mfp_set_interrupt_enable(uint16_t vector, bool enabled);
 
+// Starts a timer in delay mode, or stops it with XB_MFP_TIMER_STOP.
+// The timer counts down from count (0 meaning 256) once per prescaler period,
+// and generates an interrupt and reloads when it reaches zero.
+// timer:    XB_MFP_TIMER_*
+// prescale: XB_MFP_TIMER_STOP or XB_MFP_TIMER_DIV_*
+void xb_mfp_set_timer(uint16_t timer, uint8_t prescale, uint8_t count);
+
+// Reads the current count of a timer.
+uint8_t xb_mfp_get_timer_count(uint16_t timer);
+
+// A timer's settings, kept so that a timer Human68k uses (e.g. Timer C for the
+// cursor and FDD motor) can be given back as it was.
+typedef struct XBMfpTimerState
+{
+	uint8_t control;  // Prescaler (delay mode) or mode bits.
+	uint8_t count;    // Reload count.
+} XBMfpTimerState;
+
+// Records a timer's settings. The data register reads back the current count
+// rather than the reload value, so for a running timer this waits (up to one
+// period, 12.8ms at most) for the count to wrap, and takes the value it
+// reloads to. Interrupts are only masked for the last couple of counts. The
+// count is exact at DIV_10 and slower (Human68k's Timer C runs at DIV_200),
+// and may be a count low at DIV_4.
+void xb_mfp_save_timer(uint16_t timer, XBMfpTimerState *out);
+
+// Restarts a timer with settings from xb_mfp_save_timer().
+void xb_mfp_restore_timer(uint16_t timer, const XBMfpTimerState *state);
+
 #endif
@@ -6,6 +6,22 @@
 // Register writes are written to a static cache, rather than being sent
 // immediately to the chip. A final commit function writes any changed
 // registers to the chip.
+//
+// Each cache entry holds the data in the lower byte. Bit 15 marks data that is
+// waiting for the commit, and bit 14 marks data that has been sent to the chip
+// (XB_OPM_CACHE_PENDING / XB_OPM_CACHE_SENT). The cache keeps sent values, so
+// it is also an image of the chip's registers.
+//
+// Changed registers are also marked in a bitmap, so the commit only visits
+// those. They are written from the highest register number down, which sends
+// operator parameters first, then channel frequency and connection, and key
+// on (register $08) last.
+//
+// When XB_OPM_QUEUE is defined, writes are passed to the write queue instead
+// of waiting on the chip (see opm_queue.h).
+//
+// When XB_OPM_HOST_SIM is defined, chip accesses go to xb_opm_sim_write() and
+// xb_opm_sim_status() instead, for the host build in tools/opmsim.
 #pragma once
 
 // TODO: Define without negative value shifted left
@@ -17,7 +33,9 @@
 #ifndef __ASSEMBLER__
 #include <stdint.h>
 #include <stdbool.h>
+#include "xbase/ipl.h"
 #include "xbase/memmap.h"
+#include "xbase/opm_queue.h"
 #endif
 
 //
@@ -90,19 +108,77 @@
 #define OPM_NOTE_X2 0xB
 #define OPM_NOTE_X3 0xF
 
+// Flags in the upper byte of g_xb_opm_reg_cache entries.
+#define XB_OPM_CACHE_PENDING 0x8000
+#define XB_OPM_CACHE_SENT    0x4000
+
+// One bit per register in g_xb_opm_reg_cache.
+#define XB_OPM_DIRTY_BYTES (0x100 / 8)
+
 #ifdef __ASSEMBLER__
 	.global	g_xb_opm_reg_cache
+	.global	g_xb_opm_dirty_bitmap
 #else
 extern volatile uint16_t g_xb_opm_reg_cache[0x100];
+// Bit (addr & 7) of byte (addr >> 3) is set when register addr has changed.
+extern volatile uint8_t g_xb_opm_dirty_bitmap[XB_OPM_DIRTY_BYTES];
 #endif
 
 
+//
+// Patches
+//
+// A patch holds every register of one channel's instrument, in register order,
+// with the operators in slot order (M1, M2, C1, C2). It is 26 bytes.
+//
+// A bank is a set of patches, as made by tools/opmbank:
+//   $00 'O', 'B'  magic
+//   $02 uint16_t  Patch count
+//   $04           XBOpmPatch[count]
+#define XB_OPM_BANK_HEADER_BYTES 4
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBOpmPatch.fl_con:	ds.b 1  ; FL << 3 | CON
+XBOpmPatch.pms_ams:	ds.b 1  ; PMS << 4 | AMS
+XBOpmPatch.dt1_mul:	ds.b XB_OPM_OP_COUNT
+XBOpmPatch.tl:		ds.b XB_OPM_OP_COUNT
+XBOpmPatch.ks_ar:	ds.b XB_OPM_OP_COUNT
+XBOpmPatch.ame_d1r:	ds.b XB_OPM_OP_COUNT
+XBOpmPatch.dt2_d2r:	ds.b XB_OPM_OP_COUNT
+XBOpmPatch.d1l_rr:	ds.b XB_OPM_OP_COUNT
+XBOpmPatch.len:
+#else
+typedef struct XBOpmPatch
+{
+	uint8_t fl_con;   // FL << 3 | CON
+	uint8_t pms_ams;  // PMS << 4 | AMS
+	uint8_t dt1_mul[XB_OPM_OP_COUNT];
+	uint8_t tl[XB_OPM_OP_COUNT];
+	uint8_t ks_ar[XB_OPM_OP_COUNT];
+	uint8_t ame_d1r[XB_OPM_OP_COUNT];
+	uint8_t dt2_d2r[XB_OPM_OP_COUNT];
+	uint8_t d1l_rr[XB_OPM_OP_COUNT];
+} XBOpmPatch;
+#endif
+
 #ifdef __ASSEMBLER__
 	.global	xb_opm_commit
+	.global	xb_opm_load_patch
 #else
 // Call when you are done updating cached registers.
 void xb_opm_commit(void);  // --> opm_commit.a68
 
+// Sets a channel's instrument registers in the cache from a patch, skipping
+// registers that already hold the same value. The pan bits of the channel are
+// kept. The data is sent by the next xb_opm_commit().
+// Returns the number of registers that changed.
+uint16_t xb_opm_load_patch(uint8_t channel, const XBOpmPatch *patch);  // --> opm_patch.a68
+
+// Returns a patch from a bank, or NULL if index is out of range.
+static inline const XBOpmPatch *xb_opm_bank_get_patch(const void *bank,
+                                                      uint16_t index);
+
 //
 // Interface and config
 //
@@ -116,7 +192,10 @@ static inline void xb_opm_set_lfo_reset(bool en);
 // These registers are updated immediately.
 //
 
-// Writes a value immediately to the OPM and clears associated cached data.
+// Writes a value immediately to the OPM. Any pending cached data for the
+// register is replaced. Interrupts are masked from the address write to the
+// data write, so an interrupt handler that writes to the OPM (such as opmseq
+// on Timer B) can not move the address latch in between.
 static inline void xb_opm_write(uint8_t addr, uint8_t data);
 
 static inline void xb_opm_set_key_on(uint8_t channel, uint8_t sn);
@@ -205,9 +284,26 @@ static inline void xb_opm_set_d1l_rr(uint8_t channel, uint8_t op, uint8_t d1l, u
 // Static implementations
 //
 
+static inline const XBOpmPatch *xb_opm_bank_get_patch(const void *bank,
+                                                      uint16_t index)
+{
+	const uint8_t *b = (const uint8_t *)bank;
+	if (index >= ((b[2] << 8) | b[3])) return (const XBOpmPatch *)0;
+	return (const XBOpmPatch *)(b + XB_OPM_BANK_HEADER_BYTES) + index;
+}
+
+#ifdef XB_OPM_HOST_SIM
+void xb_opm_sim_write(uint8_t addr, uint8_t data);
+uint8_t xb_opm_sim_status(void);
+#endif  // XB_OPM_HOST_SIM
+
 static inline uint8_t opm_status(void)
 {
+#ifdef XB_OPM_HOST_SIM
+	return xb_opm_sim_status();
+#else
 	return *(volatile uint8_t *)(XB_OPM_BASE + 3);
+#endif  // XB_OPM_HOST_SIM
 }
 
 static inline void xb_opm_set_lfo_reset(bool en)
@@ -217,12 +313,21 @@ static inline void xb_opm_set_lfo_reset(bool en)
 
 void xb_opm_write(uint8_t addr, uint8_t data)
 {
+#ifdef XB_OPM_QUEUE
+	xb_opm_queue_write(addr, data);
+#elif defined(XB_OPM_HOST_SIM)
+	g_xb_opm_reg_cache[addr] = XB_OPM_CACHE_SENT | data;
+	xb_opm_sim_write(addr, data);
+#else
 	volatile uint8_t *opm = (volatile uint8_t *)(XB_OPM_BASE + 1);
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
 	while (opm[2] & 0x80) __asm__ volatile("nop");
 	opm[0] = addr;
-	g_xb_opm_reg_cache[addr] = 0;
+	g_xb_opm_reg_cache[addr] = XB_OPM_CACHE_SENT | data;
 	while (opm[2] & 0x80) __asm__ volatile("nop");
 	opm[2] = data;
+	xb_set_ipl(ipl);
+#endif  // XB_OPM_QUEUE
 }	// --> opm_commit.a68
 
 static inline void xb_opm_set_key_on(uint8_t channel, uint8_t sn)
@@ -248,7 +353,8 @@ static inline void xb_opm_set_timer_flags(uint8_t flags)
 
 static inline void xb_opm_set(uint8_t addr, uint8_t data)
 {
-	g_xb_opm_reg_cache[addr] = 0x8000 | data;
+	g_xb_opm_reg_cache[addr] = XB_OPM_CACHE_PENDING | data;
+	g_xb_opm_dirty_bitmap[addr >> 3] |= 1 << (addr & 7);
 }
 
 static inline void xb_opm_set_noise(bool en, uint8_t nfreq)
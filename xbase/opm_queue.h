@@ -0,0 +1,115 @@
+//
+// XBase OPM Write Queue (opm_queue)
+// (c) Michael Moffitt 2024
+//
+// The YM2151 is busy for a short while after each data write, and writing to
+// it again before the busy flag clears is not allowed. xb_opm_write() and
+// xb_opm_commit() normally spin on the busy flag, which costs CPU time on
+// every register.
+//
+// The write queue instead places address / data pairs in a ring buffer, and
+// an MFP Timer A interrupt sends one pair per tick, at a rate the chip will
+// accept. The timer is stopped while the queue is empty, so no interrupts are
+// taken when there is nothing to send.
+//
+// To have xb_opm_write() and xb_opm_commit() use the queue, define
+// XB_OPM_QUEUE in both CFLAGS and ASFLAGS, and call xb_opm_queue_init() before
+// any register writes. xb_opm_queue_write() may also be used directly.
+//
+// The pending writes are sent in order, a tick apart, so music code should
+// expect its register updates to land spread across the tick period multiplied
+// by the number of writes (about 5ms for 128 writes at the default rate)
+// rather than all at once.
+//
+// Timer A is also used by IOCS _VDISPST; the two can not be used together.
+//
+// The queue does not save CPU time. A write costs about 270 cycles to push
+// and 334 to send from the interrupt, against the direct path's 40 cycles
+// plus however long it waits on the busy flag (up to 160 cycles, as the chip
+// is busy for 64 OPM clocks after a data write). tools/opmsim -q runs the
+// drivers through a model of both paths, with those costs counted from the
+// 68000 timings; for a song keeping all eight channels busy (1560 writes a
+// second), it reports:
+//
+//   direct:          188 cycles per write, 2.9% of the CPU
+//   queue, 20us tick: 817 cycles per write, 12.8% (half the ticks find the
+//                    chip still busy)
+//   queue, 40us tick: 623 cycles per write, 9.7%
+//
+// What the queue buys is that the writer never waits: a burst such as a full
+// xb_opm_commit() returns after the pushes instead of stalling for the busy
+// time of every register, and the sends are spread over the following ticks.
+// Use it where a stall is worse than the extra CPU time, e.g. when register
+// updates must not hold up the main loop at a frame deadline; otherwise the
+// direct path is cheaper.
+//
+// xb_opm_queue_get_stats() reports how many writes were sent from the timer
+// interrupt, how many ticks found the chip still busy, and how often a write
+// found the queue full.
+//
+// Writes are pushed with interrupts masked, so the main program and interrupt
+// handlers may all write through the queue, and their writes never interleave
+// on the chip. A write made when the queue is full sends the oldest pending
+// write itself (waiting on the busy flag, as the direct path does) rather than
+// waiting for the timer interrupt, so pushing is safe at any IPL, including
+// from other MFP interrupt handlers, which the timer interrupt can not
+// preempt.
+#pragma once
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#endif
+
+// Number of writes that may be pending. Must be a power of two.
+#define XB_OPM_QUEUE_DEPTH 256
+
+// Timer A period in microseconds (DIV_4 prescaler). This must be longer than
+// the interrupt itself (about 33us at 10MHz) plus the busy time after its data
+// write, or every other tick only finds the chip busy.
+#ifndef XB_OPM_QUEUE_TIMER_COUNT
+#define XB_OPM_QUEUE_TIMER_COUNT 40
+#endif
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBOpmQueueStats.writes:		ds.l 1
+XBOpmQueueStats.busy_ticks:	ds.l 1
+XBOpmQueueStats.full_sends:	ds.l 1
+XBOpmQueueStats.len:
+
+	.global	xb_opm_queue_init
+	.global	xb_opm_queue_shutdown
+	.global	xb_opm_queue_write
+	.global	xb_opm_queue_pending
+	.global	xb_opm_queue_flush
+	.global	xb_opm_queue_get_stats
+	.global	opm_queue_push_sub
+#else
+typedef struct XBOpmQueueStats
+{
+	uint32_t writes;      // Writes sent by the timer interrupt.
+	uint32_t busy_ticks;  // Ticks skipped because the chip was still busy.
+	uint32_t full_sends;  // Writes that found the queue full, and sent one.
+} XBOpmQueueStats;
+
+// Installs the Timer A handler. Returns the previous Timer A handler.
+void *xb_opm_queue_init(void);
+
+// Sends any pending writes, then stops the timer and restores the handler
+// that was present before xb_opm_queue_init().
+void xb_opm_queue_shutdown(void);
+
+// Queues a register write. If the queue is full, the oldest pending write is
+// sent first, waiting on the chip if needed. Safe to call at any IPL.
+void xb_opm_queue_write(uint8_t addr, uint8_t data);
+
+// Returns the number of writes that have not been sent yet.
+uint16_t xb_opm_queue_pending(void);
+
+// Blocks until all queued writes have been sent. As this waits on the timer
+// interrupt, it must not be called with the IPL raised.
+void xb_opm_queue_flush(void);
+
+// Copies the queue statistics to out, and resets them.
+void xb_opm_queue_get_stats(XBOpmQueueStats *out);
+#endif
@@ -20,6 +20,12 @@
 //
 // Alternatively, you may directly manipulate g_xb_pal_buffer, but must be sure
 // to mark the row(s) 
+//
+// When only a few colors change (flashes, blinking text) the individual
+// entries may be set with xb_pal_set_color(), or marked with
+// xb_pal_mark_entry(). Those entries are sent with single word writes instead
+// of copying the entire row. Once more than XB_PAL_ENTRY_THRESHOLD entries in
+// a row are marked, the row is copied whole as if xb_pal_mark() were used.
 #ifndef __ASSEMBLER__
 #include <stdint.h>
 #include "xbase/memmap.h"
@@ -32,11 +38,17 @@
 #define XB_PAL_TEXT 16
 #define XB_PAL_PCG 16
 
+// Number of individually marked entries in a row above which the whole row is
+// transferred instead.
+#define XB_PAL_ENTRY_THRESHOLD 4
+
 #ifdef __ASSEMBLER__
 	.global	xb_pal_init
 	.global	xb_pal_set
 	.global	xb_pal_fill
 	.global	xb_pal_mark
+	.global	xb_pal_set_color
+	.global	xb_pal_mark_entry
 	.global	xb_pal_commit
 
 	.global	g_xb_pal_buffer
@@ -62,6 +74,13 @@ void xb_pal_fill(uint16_t row, uint16_t value);
 // by specifying 0xFFFFFFFF (all bits set).
 void xb_pal_mark(uint32_t row_bitfield);
 
+// Sets a single color in the buffer and marks that entry for uploading.
+// The index is the same as the index within g_xb_pal_buffer (row * 16 + entry).
+void xb_pal_set_color(uint16_t index, uint16_t value);
+
+// Mark a single entry as in need of a transfer to color memory.
+void xb_pal_mark_entry(uint16_t index);
+
 // Copy data from the palette buffer to color memory. Call during vblank.
 void xb_pal_commit(void);
 
@@ -0,0 +1,23 @@
+#include "xbase/util/defer.h"
+
+void xb_defer_init(XBDefer *q)
+{
+	xb_ring_init(&q->ring, q->calls, XB_DEFER_SLOTS, sizeof(XBDeferCall));
+	q->dropped = 0;
+}
+
+uint16_t xb_defer_run(XBDefer *q)
+{
+	uint16_t count = 0;
+	const XBDeferCall *c;
+	while ((c = (const XBDeferCall *)xb_ring_read_ptr(&q->ring)))
+	{
+		// The slot is freed before the call, which may take a while.
+		const XBDeferFunc func = c->func;
+		void *arg = c->arg;
+		xb_ring_read_done(&q->ring);
+		func(arg);
+		count++;
+	}
+	return count;
+}
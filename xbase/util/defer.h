@@ -0,0 +1,99 @@
+#pragma once
+// XBase Deferred Calls (defer)
+// (c) Michael Moffitt 2024
+//
+// Lets interrupt handlers hand work to the main loop without raising the IPL.
+//
+// XBDefer is a queue of function calls on an XBRing. A handler posts a
+// function and an argument with xb_defer_post(), and the main loop runs them
+// in order with xb_defer_run(). Posting never waits; if the queue is full the
+// call is dropped and counted. Like XBRing, a queue has one producer, so give
+// each interrupt handler its own.
+//
+// Flags are for work that only needs doing once no matter how many times it
+// was asked for (e.g. "the OPM queue ran dry"). They are raised with tas,
+// which is a single indivisible read-modify-write, so any number of handlers
+// may raise the same flag. xb_defer_flag_take() clears the flag before
+// returning true, so a raise that comes in after it is seen the next time.
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/util/ring.h"
+#endif
+
+#ifndef XB_DEFER_SLOTS
+#define XB_DEFER_SLOTS 32  // Power of two.
+#endif
+
+#ifdef __ASSEMBLER__
+	.global	xb_defer_init
+	.global	xb_defer_run
+#else
+
+typedef void (*XBDeferFunc)(void *arg);
+
+typedef struct XBDeferCall
+{
+	XBDeferFunc func;
+	void *arg;
+} XBDeferCall;
+
+typedef struct XBDefer
+{
+	XBRing ring;
+	XBDeferCall calls[XB_DEFER_SLOTS];
+	volatile uint16_t dropped;  // Posts lost to a full queue.
+} XBDefer;
+
+void xb_defer_init(XBDefer *q);
+
+// Queues a call. Returns false if the queue was full.
+static inline bool xb_defer_post(XBDefer *q, XBDeferFunc func, void *arg);
+
+// Runs the queued calls, including any posted while running.
+// Returns the number run.
+uint16_t xb_defer_run(XBDefer *q);
+
+static inline void xb_defer_flag_raise(volatile uint8_t *flag);
+
+// Returns true, clearing the flag, if it was raised.
+static inline bool xb_defer_flag_take(volatile uint8_t *flag);
+
+//
+// Static implementations
+//
+
+static inline bool xb_defer_post(XBDefer *q, XBDeferFunc func, void *arg)
+{
+	XBDeferCall *c = (XBDeferCall *)xb_ring_write_ptr(&q->ring);
+	if (!c)
+	{
+		q->dropped = q->dropped + 1;
+		return false;
+	}
+	c->func = func;
+	c->arg = arg;
+	xb_ring_write_done(&q->ring);
+	return true;
+}
+
+static inline void xb_defer_flag_raise(volatile uint8_t *flag)
+{
+#ifdef __m68k__
+	__asm__ volatile("tas %0" : "+m"(*flag) : : "cc");
+#else
+	// Host builds (tools/ringtest).
+	__atomic_test_and_set((void *)flag, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline bool xb_defer_flag_take(volatile uint8_t *flag)
+{
+	if (!*flag) return false;
+	*flag = 0;
+	XB_BARRIER();
+	return true;
+}
+
+#endif  // __ASSEMBLER__
@@ -1,9 +1,34 @@
 #include "xbase/util/display.h"
+#include "xbase/util/vbl_wait.h"
 #include "xbase/mfp.h"
+#include "xbase/macro.h"
+#include <stddef.h>
 #include <iocs.h>
 
+#ifdef XB_DISPLAY_512PX_PCG_HACK
+// Scanlines to leave the hack configuration in place for.
+#ifndef XB_DISPLAY_PCG_HACK_LINES
+#define XB_DISPLAY_PCG_HACK_LINES 2
+#endif  // XB_DISPLAY_PCG_HACK_LINES
+
+// Waits for the given number of complete scanlines by watching HSYNC.
+static void wait_lines(uint16_t lines)
+{
+	while (lines--)
+	{
+		while (!(xb_mfp_read_gpdr() & XB_BITVAL(XB_MFP_GPDR_HSYNC))) {}
+		while (xb_mfp_read_gpdr() & XB_BITVAL(XB_MFP_GPDR_HSYNC)) {}
+	}
+}
+#endif  // XB_DISPLAY_512PX_PCG_HACK
+
+// The display with a pending change, for the vblank hook.
+static XBDisplay *s_pending_display;
+
 static void apply_mode(const XBDisplayMode *mode)
 {
+	// The video controller screen setting has to match the CRTC flags, and the
+	// PCG timing is derived from the CRTC, so they go in that order.
 	xb_crtc_set_timing(&mode->crtc);
 	xb_vidcon_init(&mode->vidcon);
 
@@ -18,7 +43,7 @@ static void apply_mode(const XBDisplayMode *mode)
 	};
 
 	xb_pcg_init(&hires_hack_pcg);
-	for (int i = 0; i < 1000; i++) __asm__("nop");
+	wait_lines(XB_DISPLAY_PCG_HACK_LINES);
 #endif  // XB_DISPLAY_512PX_PCG_HACK
 
 	xb_pcg_init(&mode->pcg);
@@ -32,8 +57,13 @@ void xb_display_init(XBDisplay *d, const XBDisplayMode *modes,
 	d->modes = modes;
 	d->num_modes = num_modes;
 	d->current_mode = 0;
+	d->pending_mode = -1;
+	d->switch_frames = 0;
+	d->request_frame = 0;
 
 	apply_mode(&d->modes[0]);
+	xb_vbl_remove_commit(xb_display_vbl);
+	xb_vbl_add_commit(xb_display_vbl, XB_VBL_PRIO_DISPLAY, XB_VBL_COMMIT_ALWAYS);
 }
 
 const XBDisplayMode *xb_display_get_mode(const XBDisplay *d)
@@ -44,10 +74,41 @@ const XBDisplayMode *xb_display_get_mode(const XBDisplay *d)
 // Go to the next display mode.
 void xb_display_cycle_mode(XBDisplay *d)
 {
-	d->current_mode++;
-	if (d->current_mode >= d->num_modes)
+	int16_t next = d->current_mode + 1;
+	if (next >= d->num_modes)
 	{
-		d->current_mode = 0;
+		next = 0;
 	}
+	xb_display_set_mode(d, next);
+}
+
+void xb_display_set_mode(XBDisplay *d, int16_t mode)
+{
+	if (mode < 0 || mode >= d->num_modes) return;
+	d->request_frame = xb_vbl_get_frame_count();
+	s_pending_display = d;
+	// Written last, as this is what the vblank hook checks.
+	d->pending_mode = mode;
+}
+
+bool xb_display_is_pending(const XBDisplay *d)
+{
+	return d->pending_mode >= 0;
+}
+
+uint16_t xb_display_get_switch_frames(const XBDisplay *d)
+{
+	return d->switch_frames;
+}
+
+void xb_display_vbl(void)
+{
+	XBDisplay *d = s_pending_display;
+	if (d == NULL || d->pending_mode < 0) return;
+
+	d->current_mode = d->pending_mode;
 	apply_mode(&d->modes[d->current_mode]);
+	d->switch_frames = xb_vbl_get_frame_count() - d->request_frame;
+	d->pending_mode = -1;
+	s_pending_display = NULL;
 }
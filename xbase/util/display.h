@@ -1,7 +1,15 @@
 // Monitor config management.
+//
+// Mode changes requested with xb_display_cycle_mode() or xb_display_set_mode()
+// are applied from the vertical blank interrupt (see vbl_wait.h), so the CRTC,
+// video controller and PCG are never reprogrammed in the middle of the visible
+// frame. xb_display_init() registers the vblank commit that does this (at
+// XB_VBL_PRIO_DISPLAY, run on every vblank), so xb_vbl_wait_init() must be
+// used as well.
 #pragma once
 
 #ifndef __ASSEMBLER__
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "xbase/pcg.h"
@@ -21,6 +29,9 @@ XBDisplayMode.len:
 XBDisplay.modes:		ds.l 1
 XBDisplay.num_modes:	ds.w 1
 XBDisplay.current_mode:	ds.w 1
+XBDisplay.pending_mode:	ds.w 1
+XBDisplay.switch_frames:	ds.w 1
+XBDisplay.request_frame:	ds.l 1
 XBDisplay.len:
 #else
 typedef struct XBDisplayMode
@@ -35,6 +46,9 @@ typedef struct XBDisplay
 	const XBDisplayMode *modes;
 	int16_t num_modes;
 	int16_t current_mode;
+	volatile int16_t pending_mode;  // -1 when no change is pending.
+	volatile uint16_t switch_frames;  // Frames taken by the last change.
+	uint32_t request_frame;  // Frame count when the change was requested.
 } XBDisplay;
 #endif
 
@@ -42,16 +56,34 @@ typedef struct XBDisplay
 	.global	xb_display_init
 	.global	xb_display_get_mode
 	.global	xb_display_cycle_mode
+	.global	xb_display_set_mode
+	.global	xb_display_is_pending
+	.global	xb_display_get_switch_frames
+	.global	xb_display_vbl
 #else
 // Initialize with a list of display modes. The first mode from the list is
-// applied to the video chipset.
+// applied to the video chipset immediately.
 void xb_display_init(XBDisplay *d, const XBDisplayMode *modes,
                      int16_t num_modes);
 
 // Get the current display mode information.
 const XBDisplayMode *xb_display_get_mode(const XBDisplay *d);
 
-// Go to the next display mode.
+// Request the next display mode. It is applied during the next vblank.
 void xb_display_cycle_mode(XBDisplay *d);
 
+// Request a specific display mode. It is applied during the next vblank.
+void xb_display_set_mode(XBDisplay *d, int16_t mode);
+
+// Returns true while a requested mode change has not yet been applied.
+bool xb_display_is_pending(const XBDisplay *d);
+
+// Returns the number of frames between the last mode change request and when
+// it was applied.
+uint16_t xb_display_get_switch_frames(const XBDisplay *d);
+
+// Applies a pending mode change. This is registered as a vblank commit by
+// xb_display_init(), and does not need to be called otherwise.
+void xb_display_vbl(void);
+
 #endif
@@ -0,0 +1,116 @@
+#include "xbase/util/frame.h"
+
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+#include "xbase/util/prof.h"
+#include "xbase/util/vbl_wait.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define US_PER_SECOND 1000000UL
+
+#if defined(XB_PROF) && XB_FRAME_TIMER == XB_PROF_TIMER
+#error "XB_FRAME_TIMER and XB_PROF_TIMER must be different timers"
+#endif
+
+static struct
+{
+	volatile uint32_t timer_ticks;  // Counted by the timer interrupt.
+	uint32_t acc;                   // Microseconds times logic_hz.
+	uint32_t step;                  // XB_FRAME_TIMER_US times logic_hz.
+	uint32_t base;                  // Tick count at init (vertical blank).
+	uint32_t consumed;              // Ticks handed out or dropped.
+	bool use_timer;
+	void *prev_isr;
+	XBMfpTimerState prev_timer;
+	XBFrameStats stats;
+} s_frame;
+
+static void XB_ISR frame_timer_isr(void)
+{
+	// Above 400Hz, more than one tick is due per interrupt.
+	s_frame.acc += s_frame.step;
+	while (s_frame.acc >= US_PER_SECOND)
+	{
+		s_frame.acc -= US_PER_SECOND;
+		s_frame.timer_ticks++;
+	}
+}
+
+void *xb_frame_init(uint16_t logic_hz)
+{
+	// Saved first, as it may wait on the timer with interrupts enabled.
+	XBMfpTimerState prev_timer;
+	if (logic_hz) xb_mfp_save_timer(XB_FRAME_TIMER, &prev_timer);
+
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	memset(&s_frame, 0, sizeof(s_frame));
+	s_frame.use_timer = logic_hz != 0;
+	if (s_frame.use_timer)
+	{
+		s_frame.prev_timer = prev_timer;
+		s_frame.step = (uint32_t)XB_FRAME_TIMER_US * logic_hz;
+		s_frame.prev_isr = xb_mfp_set_interrupt(XB_FRAME_TIMER_VECTOR,
+		                                        frame_timer_isr);
+		xb_mfp_set_timer(XB_FRAME_TIMER, XB_FRAME_TIMER_PRESCALE,
+		                 XB_FRAME_TIMER_COUNT);
+		xb_mfp_set_interrupt_enable(XB_FRAME_TIMER_VECTOR, true);
+	}
+	else
+	{
+		s_frame.base = xb_vbl_get_frame_count();
+	}
+	xb_set_ipl(ipl);
+	return s_frame.prev_isr;
+}
+
+void xb_frame_shutdown(void)
+{
+	if (!s_frame.use_timer) return;
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	xb_mfp_set_interrupt(XB_FRAME_TIMER_VECTOR, s_frame.prev_isr);
+	xb_mfp_restore_timer(XB_FRAME_TIMER, &s_frame.prev_timer);
+	s_frame.use_timer = false;
+	xb_set_ipl(ipl);
+}
+
+uint32_t xb_frame_get_ticks(void)
+{
+	if (s_frame.use_timer) return s_frame.timer_ticks;
+	return xb_vbl_get_frame_count() - s_frame.base;
+}
+
+uint16_t xb_frame_wait(void)
+{
+	uint32_t due = xb_frame_get_ticks() - s_frame.consumed;
+	while (due == 0)
+	{
+		// Vertical blank wakes the loop once per tick; the timer is polled.
+		if (!s_frame.use_timer) xb_vbl_wait();
+		due = xb_frame_get_ticks() - s_frame.consumed;
+	}
+	s_frame.consumed += due;
+
+	if (due > s_frame.stats.max_behind)
+	{
+		s_frame.stats.max_behind = (due > 0xFFFF) ? 0xFFFF : due;
+	}
+	if (due > 1) s_frame.stats.spikes++;
+	if (due > XB_FRAME_MAX_CATCHUP)
+	{
+		s_frame.stats.dropped += due - XB_FRAME_MAX_CATCHUP;
+		due = XB_FRAME_MAX_CATCHUP;
+	}
+	s_frame.stats.updates += due;
+	s_frame.stats.renders++;
+	s_frame.stats.skipped += due - 1;
+	return due;
+}
+
+void xb_frame_get_stats(XBFrameStats *out)
+{
+	*out = s_frame.stats;
+	memset(&s_frame.stats, 0, sizeof(s_frame.stats));
+}
@@ -0,0 +1,110 @@
+#pragma once
+// XBase Frame Scheduler (frame)
+// (c) Michael Moffitt 2024
+//
+// Runs game logic at a fixed rate, and renders once for however many logic
+// updates were due. When a frame runs long, the next wait returns more than
+// one update, so the logic catches up and the renders in between are skipped.
+// If it falls more than XB_FRAME_MAX_CATCHUP updates behind, the rest are
+// dropped (the game slows down instead of stalling on updates).
+//
+//   xb_frame_init(0);
+//   while (running)
+//   {
+//       uint16_t n = xb_frame_wait();
+//       while (n--) game_update();
+//       game_render();
+//   }
+//
+// Logic ticks come from one of two places:
+//   - vertical blank (logic_hz of 0): one tick per xb_vbl_get_frame_count()
+//     step, so logic runs at the display rate. xb_vbl_wait_init() must have
+//     been called.
+//   - an MFP timer (logic_hz above 0): the timer interrupts every
+//     XB_FRAME_TIMER_US, and a tick is counted each time 1 / logic_hz seconds
+//     have built up (so rates above 400Hz count their ticks in bunches).
+//     This keeps logic at, for example, 60Hz while a crtcgen mode shows
+//     55Hz. The timer runs independently of the display, so a rendered frame
+//     may show two updates or none.
+//
+// The timer is XB_FRAME_TIMER, Timer C by default (which Human68k uses for the
+// cursor and the FDD motor; its handler and settings are replaced until
+// xb_frame_shutdown(), which puts both back).
+// Timer D is the profiler's default, and Timer A the OPM queue's; with XB_PROF,
+// the two timers must differ.
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/mfp.h"
+#endif
+
+#ifndef XB_FRAME_MAX_CATCHUP
+#define XB_FRAME_MAX_CATCHUP 4
+#endif
+
+#ifndef XB_FRAME_TIMER
+#define XB_FRAME_TIMER XB_MFP_TIMER_C
+#endif
+
+// Timer interrupt period: 50 counts of 50us.
+#define XB_FRAME_TIMER_PRESCALE XB_MFP_TIMER_DIV_200
+#define XB_FRAME_TIMER_COUNT 50
+#define XB_FRAME_TIMER_US 2500
+
+#if XB_FRAME_TIMER == XB_MFP_TIMER_A
+#define XB_FRAME_TIMER_VECTOR XB_MFP_INT_TIMER_A
+#elif XB_FRAME_TIMER == XB_MFP_TIMER_C
+#define XB_FRAME_TIMER_VECTOR XB_MFP_INT_TIMER_C
+#elif XB_FRAME_TIMER == XB_MFP_TIMER_D
+#define XB_FRAME_TIMER_VECTOR XB_MFP_INT_TIMER_D
+#else
+#error "XB_FRAME_TIMER must be Timer A, C or D"
+#endif
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBFrameStats.updates:	ds.l 1
+XBFrameStats.renders:	ds.l 1
+XBFrameStats.skipped:	ds.l 1
+XBFrameStats.dropped:	ds.l 1
+XBFrameStats.spikes:	ds.l 1
+XBFrameStats.max_behind:	ds.w 1
+XBFrameStats.len:
+
+	.global	xb_frame_init
+	.global	xb_frame_shutdown
+	.global	xb_frame_wait
+	.global	xb_frame_get_ticks
+	.global	xb_frame_get_stats
+#else
+
+typedef struct XBFrameStats
+{
+	uint32_t updates;     // Logic updates returned by xb_frame_wait().
+	uint32_t renders;     // Calls to xb_frame_wait().
+	uint32_t skipped;     // Renders skipped to catch up (updates - renders).
+	uint32_t dropped;     // Ticks discarded beyond XB_FRAME_MAX_CATCHUP.
+	uint32_t spikes;      // Waits that found more than one tick due.
+	uint16_t max_behind;  // Most ticks found due by one wait.
+} XBFrameStats;
+
+// Starts the scheduler. logic_hz is the logic rate, or 0 to follow vertical
+// blank. Returns the previous timer interrupt handler when a timer is used.
+void *xb_frame_init(uint16_t logic_hz);
+
+// Gives the timer, if used, back with the handler, prescaler and reload count
+// it had before xb_frame_init().
+void xb_frame_shutdown(void);
+
+// Waits until at least one logic tick is due, and returns how many logic
+// updates to run before rendering (1 to XB_FRAME_MAX_CATCHUP).
+uint16_t xb_frame_wait(void);
+
+// Logic ticks since xb_frame_init().
+uint32_t xb_frame_get_ticks(void);
+
+// Copies the statistics to out, and resets them.
+void xb_frame_get_stats(XBFrameStats *out);
+
+#endif  // __ASSEMBLER__
@@ -0,0 +1,81 @@
+#include "xbase/util/insample.h"
+
+#include "xbase/ipl.h"
+#include "xbase/joy.h"
+#include "xbase/keys.h"
+#include "xbase/macro.h"
+#include "xbase/mfp.h"
+#include "xbase/util/vbl_wait.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+static struct
+{
+	XBInputSample history[XB_INSAMPLE_HISTORY];
+	volatile uint32_t latest;  // Frame of the newest sample.
+	volatile bool taken;       // Set once the first sample is in.
+} s_insample;
+
+static void insample_commit(void)
+{
+	// Display state is read first, as close as possible to the sample.
+	const bool late = xb_mfp_read_gpdr() & XB_BITVAL(XB_MFP_GPDR_VDISP);
+	const uint32_t frame = xb_vbl_get_frame_count();
+	XBInputSample *s = &s_insample.history[frame & (XB_INSAMPLE_HISTORY - 1)];
+	xb_joy_poll();
+	memcpy(s->joy, g_xb_joystate, sizeof(s->joy));
+	xb_keys_read_matrix(s->keys);
+	s->flags = late ? XB_INSAMPLE_LATE : 0;
+	s->frame = frame;
+	s_insample.latest = frame;
+	s_insample.taken = true;
+}
+
+bool xb_insample_init(void)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	xb_vbl_remove_commit(insample_commit);
+	memset(&s_insample, 0, sizeof(s_insample));
+	const bool ok = xb_vbl_add_commit(insample_commit, XB_VBL_PRIO_INPUT,
+	                                  XB_VBL_COMMIT_ALWAYS);
+	xb_set_ipl(ipl);
+	return ok;
+}
+
+void xb_insample_shutdown(void)
+{
+	xb_vbl_remove_commit(insample_commit);
+}
+
+uint32_t xb_insample_latest_frame(void)
+{
+	return s_insample.latest;
+}
+
+bool xb_insample_get(uint32_t frame, XBInputSample *out)
+{
+	if (!s_insample.taken) return false;
+	if ((uint32_t)(s_insample.latest - frame) >= XB_INSAMPLE_HISTORY)
+	{
+		return false;
+	}
+	const XBInputSample *s = &s_insample.history[frame &
+	                                             (XB_INSAMPLE_HISTORY - 1)];
+	if (s->frame != frame) return false;
+	memcpy(out, s, sizeof(*out));
+	// The interrupt may have reused the slot during the copy.
+	XB_BARRIER();
+	return s->frame == frame;
+}
+
+bool xb_insample_latest(XBInputSample *out)
+{
+	// A new sample may arrive between reading latest and the copy; the newer
+	// one is then fetched instead.
+	for (;;)
+	{
+		if (!s_insample.taken) return false;
+		if (xb_insample_get(s_insample.latest, out)) return true;
+	}
+}
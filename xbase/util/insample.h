@@ -0,0 +1,98 @@
+#pragma once
+// XBase Vertical Blank Input Sampling (insample)
+// (c) Michael Moffitt 2024
+//
+// Samples the joypads and the key matrix from the vertical blank interrupt,
+// instead of whenever the main loop gets around to xb_joy_poll() and
+// xb_keys_poll(). Input is then always read at the same point in the frame,
+// however long the previous frame took, so the time from a press to the frame
+// showing its result is constant. The samples are kept in a history of the
+// last XB_INSAMPLE_HISTORY frames, indexed by frame number; recording them is
+// enough to replay a session exactly.
+//
+//   xb_vbl_wait_init();
+//   xb_joy_init();
+//   xb_keys_init(NULL);
+//   xb_insample_init();
+//   while (running)
+//   {
+//       XBInputSample in;
+//       xb_insample_latest(&in);
+//       xb_keys_poll_matrix(in.keys, in.frame);
+//       game_update(&in.joy[0], &in.joy[1]);
+//       ...
+//   }
+//
+// Sampling runs as a vblank commit (see vbl_wait.h) at XB_VBL_PRIO_INPUT,
+// ahead of the others, and calls xb_joy_poll() itself, so joypad modes
+// (including six-button) work as usual. Each sample holds the XBJoyState of
+// both ports, with edges relative to the previous vblank; a main loop that
+// skips frames should compare now against the sample it last used instead.
+// Do not call xb_joy_poll() from the main loop while sampling.
+//
+// The key matrix comes from xb_keys_read_matrix(); pass it to
+// xb_keys_poll_matrix() in place of xb_keys_poll() to keep key events and
+// repeat working. Without XB_KEYS_USART, reading it takes fifteen IOCS calls
+// (on the order of 2000 cycles) in the interrupt.
+//
+// The CRTC has no readable raster counter, so the raster position of a sample
+// is given only as whether it was taken inside vertical blank; a sample taken
+// after the display restarted (because other interrupts held it up) has
+// XB_INSAMPLE_LATE set.
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/joy.h"
+#endif
+
+// Frames of samples kept. Must be a power of two.
+#ifndef XB_INSAMPLE_HISTORY
+#define XB_INSAMPLE_HISTORY 16
+#endif
+
+// Sample flags.
+#define XB_INSAMPLE_LATE 0x0001  // Taken after vertical blank had ended.
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBInputSample.frame:	ds.l 1
+XBInputSample.flags:	ds.w 1
+XBInputSample.joy:		ds.b XBJoyState.len*XB_JOY_COUNT
+XBInputSample.keys:		ds.b 16
+XBInputSample.len:
+
+	.global	xb_insample_init
+	.global	xb_insample_shutdown
+	.global	xb_insample_latest_frame
+	.global	xb_insample_get
+	.global	xb_insample_latest
+#else
+
+typedef struct XBInputSample
+{
+	uint32_t frame;                  // xb_vbl_get_frame_count() when taken.
+	uint16_t flags;                  // XB_INSAMPLE_*
+	XBJoyState joy[XB_JOY_COUNT];
+	uint8_t keys[16];                // Key matrix, in _iocs_bitsns() format.
+} XBInputSample;
+
+// Clears the history and registers the sampling commit. xb_vbl_wait_init(),
+// xb_joy_init() and xb_keys_init() must have been called.
+// Returns false if no commit could be registered.
+bool xb_insample_init(void);
+
+// Removes the sampling commit.
+void xb_insample_shutdown(void);
+
+// Frame number of the most recent sample.
+uint32_t xb_insample_latest_frame(void);
+
+// Copies the sample taken in a given frame. Returns false if there was none,
+// or it has already left the history.
+bool xb_insample_get(uint32_t frame, XBInputSample *out);
+
+// Copies the most recent sample. Returns false if none has been taken yet.
+bool xb_insample_latest(XBInputSample *out);
+
+#endif  // __ASSEMBLER__
@@ -0,0 +1,218 @@
+#include "xbase/util/irqlat.h"
+
+#ifdef XB_IRQLAT
+
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct XBIrqLatWatch
+{
+	uint16_t vector;        // 0 when unused.
+	uint32_t period;        // 8.8 ticks.
+	uint32_t due;           // Next due time, whole ticks...
+	uint8_t due_frac;       // ...and the fraction.
+	uint32_t last;          // Previous entry time.
+	uint32_t entries;
+	uint32_t late_sum;
+	uint32_t late_max;
+	uint32_t interval_sum;
+	uint16_t hist[XB_IRQLAT_BINS];
+} XBIrqLatWatch;
+
+static struct
+{
+	XBIrqLatWatch watch[XB_IRQLAT_VECTORS];
+	uint32_t mask_start;
+	const void *mask_raised_at;
+	XBIrqLatMask mask_max;
+	uint32_t mask_count;
+	uint32_t mask_pend_start;       // g_xb_prof_pend_reads at mask_start.
+	uint32_t mask_short;            // Stretches that may be longer.
+	uint16_t mask_hist[XB_IRQLAT_BINS];
+} s_irqlat;
+
+static inline uint16_t bin_for(uint32_t ticks)
+{
+	uint16_t bin = 0;
+	while (ticks && bin < XB_IRQLAT_BINS - 1)
+	{
+		ticks >>= 1;
+		bin++;
+	}
+	return bin;
+}
+
+static void entry(XBIrqLatWatch *w)
+{
+	const uint32_t now = xb_prof_now();
+	const uint32_t interval = now - w->last;
+	w->last = now;
+	if (w->entries++ == 0)
+	{
+		// Nothing to compare the first entry with.
+		w->due = now;
+		w->due_frac = 0;
+		return;
+	}
+	w->interval_sum += interval;
+
+	uint32_t late = interval;
+	if (w->period)
+	{
+		const uint16_t frac = w->due_frac + (w->period & 0xFF);
+		w->due += (w->period >> 8) + (frac >> 8);
+		w->due_frac = frac;
+		if ((int32_t)(now - w->due) < 0)
+		{
+			// Earlier than predicted, so the prediction was late.
+			w->due = now;
+			w->due_frac = 0;
+		}
+		late = now - w->due;
+	}
+	w->late_sum += late;
+	if (late > w->late_max) w->late_max = late;
+	w->hist[bin_for(late)]++;
+}
+
+// One chained handler per watch, as the chain does not say which it is.
+#define WATCH_HANDLER(n) \
+static bool watch_handler_##n(void) \
+{ \
+	entry(&s_irqlat.watch[n]); \
+	return true; \
+}
+
+WATCH_HANDLER(0)
+WATCH_HANDLER(1)
+WATCH_HANDLER(2)
+WATCH_HANDLER(3)
+
+static bool (* const s_handlers[XB_IRQLAT_VECTORS])(void) =
+{
+	watch_handler_0, watch_handler_1, watch_handler_2, watch_handler_3,
+};
+
+void xb_irqlat_init(void)
+{
+	const uint8_t ipl = xb_set_ipl_raw(XB_IPL_ALLOW_NONE);
+	memset(&s_irqlat, 0, sizeof(s_irqlat));
+	xb_set_ipl_raw(ipl);
+}
+
+bool xb_irqlat_watch(uint16_t vector, uint32_t period)
+{
+	for (uint16_t i = 0; i < XB_IRQLAT_VECTORS; i++)
+	{
+		XBIrqLatWatch *w = &s_irqlat.watch[i];
+		if (w->vector) continue;
+		memset(w, 0, sizeof(*w));
+		w->period = period;
+		if (!xb_mfp_chain_vector(vector, s_handlers[i])) return false;
+		w->vector = vector;
+		return true;
+	}
+	return false;
+}
+
+uint8_t xb_set_ipl(uint8_t ipl)
+{
+	const void *caller = __builtin_return_address(0);
+	if (ipl == 0 && s_irqlat.mask_raised_at)
+	{
+		// Timed before lowering, so an interrupt taken right after does not
+		// add to it.
+		const uint32_t ticks = xb_prof_now() - s_irqlat.mask_start;
+		s_irqlat.mask_count++;
+		// A wrap was pending, so more than one may have been missed.
+		const bool maybe_short =
+		    g_xb_prof_pend_reads != s_irqlat.mask_pend_start;
+		if (maybe_short) s_irqlat.mask_short++;
+		s_irqlat.mask_hist[bin_for(ticks)]++;
+		if (ticks > s_irqlat.mask_max.ticks)
+		{
+			s_irqlat.mask_max.ticks = ticks;
+			s_irqlat.mask_max.raised_at = s_irqlat.mask_raised_at;
+			s_irqlat.mask_max.lowered_at = caller;
+			s_irqlat.mask_max.maybe_short = maybe_short;
+		}
+		s_irqlat.mask_raised_at = NULL;
+	}
+	const uint8_t old = xb_set_ipl_raw(ipl);
+	if (old == 0 && ipl != 0)
+	{
+		s_irqlat.mask_start = xb_prof_now();
+		s_irqlat.mask_pend_start = g_xb_prof_pend_reads;
+		s_irqlat.mask_raised_at = caller;
+	}
+	return old;
+}
+
+void xb_irqlat_get_mask_max(XBIrqLatMask *out)
+{
+	const uint8_t ipl = xb_set_ipl_raw(XB_IPL_ALLOW_NONE);
+	*out = s_irqlat.mask_max;
+	xb_set_ipl_raw(ipl);
+}
+
+static void dump_hist(FILE *f, const uint16_t *hist)
+{
+	for (uint16_t i = 0; i < XB_IRQLAT_BINS; i++)
+	{
+		if (!hist[i]) continue;
+		const uint32_t lo = i ? (1UL << (i - 1)) : 0;
+		fprintf(f, "  %6lu+ %6u\n", (unsigned long)lo, hist[i]);
+	}
+}
+
+bool xb_irqlat_dump(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) return false;
+
+	// Copied so the numbers in one report agree with each other.
+	const uint8_t ipl = xb_set_ipl_raw(XB_IPL_ALLOW_NONE);
+	static XBIrqLatWatch watch[XB_IRQLAT_VECTORS];
+	memcpy(watch, s_irqlat.watch, sizeof(watch));
+	const XBIrqLatMask mask_max = s_irqlat.mask_max;
+	const uint32_t mask_count = s_irqlat.mask_count;
+	const uint32_t mask_short = s_irqlat.mask_short;
+	static uint16_t mask_hist[XB_IRQLAT_BINS];
+	memcpy(mask_hist, s_irqlat.mask_hist, sizeof(mask_hist));
+	xb_set_ipl_raw(ipl);
+
+	fprintf(f, "%u ns per tick\n", XB_PROF_TICK_NS);
+	for (uint16_t i = 0; i < XB_IRQLAT_VECTORS; i++)
+	{
+		const XBIrqLatWatch *w = &watch[i];
+		if (!w->vector) continue;
+		const uint32_t n = (w->entries > 1) ? (w->entries - 1) : 1;
+		fprintf(f, "\nvector $%02X: %lu entries, avg interval %lu\n", w->vector,
+		        (unsigned long)w->entries, (unsigned long)(w->interval_sum / n));
+		fprintf(f, "%s avg %lu, max %lu\n", w->period ? "latency" : "interval",
+		        (unsigned long)(w->late_sum / n), (unsigned long)w->late_max);
+		dump_hist(f, w->hist);
+	}
+
+	fprintf(f, "\nIPL raised %lu times, longest %lu (raised at $%06lX, "
+	        "lowered at $%06lX)\n", (unsigned long)mask_count,
+	        (unsigned long)mask_max.ticks, (unsigned long)mask_max.raised_at,
+	        (unsigned long)mask_max.lowered_at);
+	if (mask_short)
+	{
+		fprintf(f, "%lu of them held off a timer wrap and may be longer by "
+		        "multiples of 256 ticks%s\n", (unsigned long)mask_short,
+		        mask_max.maybe_short ? ", the longest among them" : "");
+	}
+	dump_hist(f, mask_hist);
+
+	const bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+#endif  // XB_IRQLAT
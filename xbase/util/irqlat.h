@@ -0,0 +1,93 @@
+#pragma once
+// XBase Interrupt Latency Instrumentation (irqlat)
+// (c) Michael Moffitt 2024
+//
+// Records how late interrupt handlers start, and how long the IPL is held up
+// by xb_set_ipl(), to find what delays raster effects.
+//
+// Watched vectors get a chained handler (see xb_mfp_chain_vector()) that
+// takes the time from the profiler's timer (util/prof) on entry and then runs
+// the original handler. Each watch is given the nominal period between the
+// times its interrupt is due; the due time advances by the period on each
+// entry, and the difference from the entry time is the latency. An entry
+// earlier than predicted moves the prediction back, so the smallest latency
+// seen is taken as "on time". The period should be accurate to a fraction of
+// a tick (it is 8.8 fixed point), or the latency will appear to drift. The
+// average interval is reported so a period can be checked. With a period of
+// 0, the interval between entries is recorded instead.
+//
+// Raster interrupts at several lines in a frame are not periodic. For those,
+// watch VDISP for the frame timing, and the raster vector with a period of 0;
+// the intervals then show how far apart the splits started.
+//
+// Latencies are kept in histograms with power of two bins: bin 0 is 0 ticks,
+// and bin n counts latencies from 2^(n-1) to 2^n - 1 ticks.
+//
+// With XB_IRQLAT defined (in CFLAGS and ASFLAGS), xb_set_ipl() also times how
+// long the IPL stays raised from 0, and keeps the longest stretch along with
+// the addresses it was raised and lowered from (look them up in the .map
+// file). The time spent in interrupt handlers themselves is not counted. The
+// profiler can only see one timer wrap while its interrupt is held off, so a
+// stretch of over 256 ticks loses 256 ticks per extra wrap; stretches where a
+// wrap was pending are counted as possibly longer (see util/prof). Time long
+// masked sections with a slower XB_PROF_PRESCALE.
+//
+// The time is taken after the trampoline and a C call, which adds a constant
+// of about 250 cycles (25 ticks at the default 1us tick) to every entry.
+//
+// Requires XB_PROF, and xb_prof_init() before xb_irqlat_init().
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/mfp.h"
+#include "xbase/util/prof.h"
+#endif
+
+#if defined(XB_IRQLAT) && !defined(XB_PROF)
+#error "XB_IRQLAT needs XB_PROF for its timer"
+#endif
+
+// Vectors that may be watched at once. Each uses a chain from
+// XB_MFP_CHAIN_COUNT.
+#define XB_IRQLAT_VECTORS 4
+
+#define XB_IRQLAT_BINS 16
+
+#ifdef __ASSEMBLER__
+#ifdef XB_IRQLAT
+	.global	xb_irqlat_init
+	.global	xb_irqlat_watch
+	.global	xb_irqlat_get_mask_max
+	.global	xb_irqlat_dump
+#endif  // XB_IRQLAT
+#else
+
+#ifdef XB_IRQLAT
+typedef struct XBIrqLatMask
+{
+	uint32_t ticks;         // Longest time with the IPL raised.
+	const void *raised_at;  // Return addresses of the xb_set_ipl() calls.
+	const void *lowered_at;
+	bool maybe_short;       // A wrap was pending, so ticks may be short.
+} XBIrqLatMask;
+
+// Clears the statistics.
+void xb_irqlat_init(void);
+
+// Starts watching a vector. period is the time between due times in 8.8
+// fixed point ticks (XB_PROF_TICK_NS each), or 0 to record intervals.
+// Returns false if no more vectors can be watched.
+bool xb_irqlat_watch(uint16_t vector, uint32_t period);
+
+// Longest stretch with the IPL raised by xb_set_ipl().
+void xb_irqlat_get_mask_max(XBIrqLatMask *out);
+
+// Writes the histograms and the longest masked stretch to a file.
+// Returns false if the file could not be written.
+bool xb_irqlat_dump(const char *path);
+
+// Watches are removed with xb_mfp_restore_vectors().
+#endif  // XB_IRQLAT
+
+#endif  // __ASSEMBLER__
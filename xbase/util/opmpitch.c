@@ -0,0 +1,50 @@
+#include "xbase/util/opmpitch.h"
+
+#include <string.h>
+
+void xb_opmpitch_init(XBOpmPitchEnv *e)
+{
+	memset(e, 0, sizeof(*e));
+	e->kc = 0xFF;
+	e->kf = 0xFF;
+}
+
+bool xb_opmpitch_update(XBOpmPitchEnv *e, uint8_t channel)
+{
+	// Glide
+	if (e->pitch < e->target)
+	{
+		e->pitch += e->glide_rate;
+		if (e->glide_rate == 0 || e->pitch > e->target) e->pitch = e->target;
+	}
+	else if (e->pitch > e->target)
+	{
+		e->pitch -= e->glide_rate;
+		if (e->glide_rate == 0 || e->pitch < e->target) e->pitch = e->target;
+	}
+
+	int16_t pitch = e->pitch + e->detune;
+	if (e->vib_depth)
+	{
+		pitch += (g_xb_opmpitch_sine[e->vib_phase >> 2] * e->vib_depth) >> 7;
+		e->vib_phase += e->vib_speed;
+	}
+	pitch = xb_opmpitch_clamp(pitch);
+
+	bool changed = false;
+	const uint8_t kc = xb_opmpitch_to_kc(pitch);
+	if (kc != e->kc)
+	{
+		e->kc = kc;
+		xb_opm_set(OPM_CH_OCT_NOTE + channel, kc);
+		changed = true;
+	}
+	const uint8_t kf = xb_opmpitch_to_kf(pitch);
+	if (kf != e->kf)
+	{
+		e->kf = kf;
+		xb_opm_set(OPM_CH_KF + channel, kf);
+		changed = true;
+	}
+	return changed;
+}
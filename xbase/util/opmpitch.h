@@ -0,0 +1,100 @@
+#pragma once
+// XBase OPM Linear Pitch (opmpitch)
+// (c) Michael Moffitt 2024
+//
+// The OPM takes pitch as a KC (octave and note code, where codes 3, 7 and B
+// are unused) and a KF (1/64 semitone fraction), which does not lend itself
+// to arithmetic. Here pitch is a linear value instead, in 1/64 semitones, with
+// 0 at KC $00 (C# in octave 0) and XB_OPMPITCH_MAX at the top of octave 7.
+// Glides, vibrato and detune are done by adding to it, and it is converted to
+// KC / KF with a table lookup and a mask (see tools/opmpitch for the tables).
+//
+// XBOpmPitchEnv handles glide, vibrato and detune for one channel, and only
+// sets KC and KF in the register cache when they have changed.
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/opm.h"
+#endif
+
+#define XB_OPMPITCH_SEMITONE 64
+#define XB_OPMPITCH_MAX ((8 * 12 * XB_OPMPITCH_SEMITONE) - 1)
+
+// Pitch of a note, with semitone 0 as C. The OPM clock adjustment is included,
+// so notes are in tune on the X68000.
+#define XB_OPMPITCH_NOTE(octave, semitone) \
+	(((((octave) * 12) + (semitone) - 1) * XB_OPMPITCH_SEMITONE) + \
+	 XB_OPM_CLOCK_ADJUST)
+
+#ifdef __ASSEMBLER__
+	.global	g_xb_opmpitch_kc
+	.global	g_xb_opmpitch_sine
+	.global	xb_opmpitch_init
+	.global	xb_opmpitch_update
+#else
+// KC for each semitone from C# in octave 0.
+extern const uint8_t g_xb_opmpitch_kc[96];
+// One cycle of a sine wave in 64 steps, -127 to 127.
+extern const int8_t g_xb_opmpitch_sine[64];
+
+typedef struct XBOpmPitchEnv
+{
+	int16_t pitch;       // Current pitch, moving towards target.
+	int16_t target;      // Pitch of the current note.
+	uint16_t glide_rate; // Pitch change per update; 0 to jump to target.
+	int16_t detune;      // Added to the pitch.
+	uint8_t vib_depth;   // Vibrato peak deviation, in pitch units.
+	uint8_t vib_speed;   // Vibrato phase step per update (256 per cycle).
+	uint8_t vib_phase;
+	uint8_t kc;          // Last values set in the register cache.
+	uint8_t kf;
+} XBOpmPitchEnv;
+
+// Clears the envelope. The next update sets KC and KF.
+void xb_opmpitch_init(XBOpmPitchEnv *e);
+
+// Steps glide and vibrato, and sets KC / KF for the channel in the register
+// cache if either has changed.
+// Returns true if the cache was changed.
+bool xb_opmpitch_update(XBOpmPitchEnv *e, uint8_t channel);
+
+// Starts a note. The pitch glides to it at glide_rate, or jumps if 0. The
+// vibrato phase restarts.
+static inline void xb_opmpitch_note(XBOpmPitchEnv *e, int16_t pitch,
+                                    uint16_t glide_rate);
+
+static inline int16_t xb_opmpitch_clamp(int16_t pitch);
+static inline uint8_t xb_opmpitch_to_kc(int16_t pitch);  // Pitch must be clamped.
+static inline uint8_t xb_opmpitch_to_kf(int16_t pitch);  // Value for OPM_CH_KF.
+
+//
+// Static implementations
+//
+
+static inline void xb_opmpitch_note(XBOpmPitchEnv *e, int16_t pitch,
+                                    uint16_t glide_rate)
+{
+	e->target = pitch;
+	e->glide_rate = glide_rate;
+	if (glide_rate == 0) e->pitch = pitch;
+	e->vib_phase = 0;
+}
+
+static inline int16_t xb_opmpitch_clamp(int16_t pitch)
+{
+	if (pitch < 0) return 0;
+	if (pitch > XB_OPMPITCH_MAX) return XB_OPMPITCH_MAX;
+	return pitch;
+}
+
+static inline uint8_t xb_opmpitch_to_kc(int16_t pitch)
+{
+	return g_xb_opmpitch_kc[pitch >> 6];
+}
+
+static inline uint8_t xb_opmpitch_to_kf(int16_t pitch)
+{
+	return (pitch & (XB_OPMPITCH_SEMITONE - 1)) << 2;
+}
+#endif
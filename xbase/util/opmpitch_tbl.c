@@ -0,0 +1,26 @@
+// Generated by tools/opmpitch/gen_opmpitch.py; do not edit.
+#include "xbase/util/opmpitch.h"
+
+// KC for each semitone, starting from C# in octave 0.
+const uint8_t g_xb_opmpitch_kc[96] =
+{
+	0x00, 0x01, 0x02, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0A, 0x0C, 0x0D, 0x0E,
+	0x10, 0x11, 0x12, 0x14, 0x15, 0x16, 0x18, 0x19, 0x1A, 0x1C, 0x1D, 0x1E,
+	0x20, 0x21, 0x22, 0x24, 0x25, 0x26, 0x28, 0x29, 0x2A, 0x2C, 0x2D, 0x2E,
+	0x30, 0x31, 0x32, 0x34, 0x35, 0x36, 0x38, 0x39, 0x3A, 0x3C, 0x3D, 0x3E,
+	0x40, 0x41, 0x42, 0x44, 0x45, 0x46, 0x48, 0x49, 0x4A, 0x4C, 0x4D, 0x4E,
+	0x50, 0x51, 0x52, 0x54, 0x55, 0x56, 0x58, 0x59, 0x5A, 0x5C, 0x5D, 0x5E,
+	0x60, 0x61, 0x62, 0x64, 0x65, 0x66, 0x68, 0x69, 0x6A, 0x6C, 0x6D, 0x6E,
+	0x70, 0x71, 0x72, 0x74, 0x75, 0x76, 0x78, 0x79, 0x7A, 0x7C, 0x7D, 0x7E,
+};
+
+// One sine cycle, -127 to 127.
+const int8_t g_xb_opmpitch_sine[64] =
+{
+	0, 12, 25, 37, 49, 60, 71, 81, 90, 98, 106, 112,
+	117, 122, 125, 126, 127, 126, 125, 122, 117, 112, 106, 98,
+	90, 81, 71, 60, 49, 37, 25, 12, 0, -12, -25, -37,
+	-49, -60, -71, -81, -90, -98, -106, -112, -117, -122, -125, -126,
+	-127, -126, -125, -122, -117, -112, -106, -98, -90, -81, -71, -60,
+	-49, -37, -25, -12,
+};
@@ -0,0 +1,421 @@
+#include "xbase/util/opmseq.h"
+#include "xbase/util/opmpitch.h"
+#include "xbase/util/opmvoice.h"
+
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SONG_HEADER_TRACKS 0x04
+#define SONG_HEADER_INST 0x14
+#define SONG_HEADER_VOL_MACROS 0x16
+#define SONG_HEADER_PITCH_MACROS 0x18
+
+#define MACRO_NONE 0xFF
+
+typedef struct XBOpmSeqMacro
+{
+	const uint8_t *data;  // NULL when not in use.
+	uint8_t pos;
+	int8_t value;
+} XBOpmSeqMacro;
+
+typedef struct XBOpmSeqChannel
+{
+	const uint8_t *pc;  // NULL once the channel has ended.
+	uint16_t wait;      // Ticks left in the current note or rest.
+	uint16_t release;   // Key off when wait reaches this.
+	bool keyed;
+
+	// Loop stack
+	const uint8_t *loop_pc[XB_OPMSEQ_LOOP_DEPTH];
+	uint8_t loop_count[XB_OPMSEQ_LOOP_DEPTH];
+	uint16_t loop_sp;
+
+	// Settings
+	uint8_t gate;
+	uint8_t pan;
+	uint8_t fl_con;
+	uint8_t carriers;  // Bit n set when operator slot n is a carrier.
+	uint8_t inst_tl[XB_OPM_OP_COUNT];
+	uint8_t volume;
+	int8_t detune;
+	uint8_t note;
+
+	XBOpmSeqMacro vol_macro;
+	XBOpmSeqMacro pitch_macro;
+	uint8_t vol_macro_id;
+	uint8_t pitch_macro_id;
+
+	// Last values sent to the register cache, to skip unchanged writes.
+	uint8_t kc;
+	uint8_t kf;
+	uint8_t tl[XB_OPM_OP_COUNT];
+} XBOpmSeqChannel;
+
+static struct
+{
+	const uint8_t *song;
+	XBOpmSeqChannel ch[XB_OPM_VOICE_COUNT];
+	uint8_t key_off;  // Channel bits to key off this tick.
+	uint8_t key_on;   // Channel bits to key on this tick.
+	uint16_t cmds;
+	uint16_t writes;
+	bool isr_installed;
+	XBOpmSeqStats stats;
+} s_seq;
+
+// Carrier slots for each connection (algorithm).
+static const uint8_t kcarriers[8] =
+{
+	0x08, 0x08, 0x08, 0x08, 0x0C, 0x0E, 0x0E, 0x0F
+};
+
+static inline uint16_t read16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static inline void set_reg(uint8_t addr, uint8_t data)
+{
+	xb_opmvoice_music_set(addr, data);
+	s_seq.writes++;
+}
+
+//
+// Macros
+//
+
+static void macro_start(XBOpmSeqMacro *m, uint16_t table, uint8_t id)
+{
+	m->value = 0;
+	if (id == MACRO_NONE)
+	{
+		m->data = NULL;
+		return;
+	}
+	const uint8_t *offs = s_seq.song + read16(s_seq.song + table) + (id * 2);
+	m->data = s_seq.song + read16(offs);
+	m->pos = 0;
+}
+
+static void macro_step(XBOpmSeqMacro *m)
+{
+	if (!m->data) return;
+	const uint8_t len = m->data[0];
+	if (m->pos >= len)
+	{
+		// Hold the last value for MACRO_NONE, and for a loop index that is out
+		// of range (which includes any for an empty macro).
+		if (m->data[1] >= len) return;
+		m->pos = m->data[1];
+	}
+	m->value = (int8_t)m->data[2 + m->pos];
+	m->pos++;
+}
+
+//
+// Register output
+//
+
+static void load_instrument(uint16_t ch_idx, XBOpmSeqChannel *ch, uint8_t id)
+{
+	const XBOpmPatch *patch = (const XBOpmPatch *)(s_seq.song +
+	                          read16(s_seq.song + SONG_HEADER_INST)) + id;
+	ch->fl_con = patch->fl_con;
+	ch->carriers = kcarriers[patch->fl_con & 0x07];
+	s_seq.writes += xb_opmvoice_music_load_patch(ch_idx, patch);
+	// The patch keeps the pan on the chip, which may not be the channel's.
+	set_reg(OPM_CH_PAN_FL_CON + ch_idx, ch->pan | ch->fl_con);
+
+	// Carrier levels are recalculated from the instrument TL with volume.
+	for (uint16_t op = 0; op < XB_OPM_OP_COUNT; op++)
+	{
+		ch->inst_tl[op] = patch->tl[op];
+		ch->tl[op] = ch->inst_tl[op];
+	}
+}
+
+static void update_output(uint16_t ch_idx, XBOpmSeqChannel *ch)
+{
+	// Pitch
+	const int16_t pitch = xb_opmpitch_clamp(XB_OPMPITCH_NOTE(0, ch->note) +
+	                                        ch->detune + ch->pitch_macro.value);
+	const uint8_t kc = xb_opmpitch_to_kc(pitch);
+	const uint8_t kf = xb_opmpitch_to_kf(pitch);
+	if (kc != ch->kc)
+	{
+		ch->kc = kc;
+		set_reg(OPM_CH_OCT_NOTE + ch_idx, kc);
+	}
+	if (kf != ch->kf)
+	{
+		ch->kf = kf;
+		set_reg(OPM_CH_KF + ch_idx, kf);
+	}
+
+	// Carrier levels
+	const int16_t atten = ch->volume + ch->vol_macro.value;
+	for (uint16_t op = 0; op < XB_OPM_OP_COUNT; op++)
+	{
+		if (!(ch->carriers & (1 << op))) continue;
+		int16_t tl = ch->inst_tl[op] + atten;
+		if (tl < 0) tl = 0;
+		else if (tl > 0x7F) tl = 0x7F;
+		if (tl == ch->tl[op]) continue;
+		ch->tl[op] = tl;
+		set_reg(OPM_CH_TL + ch_idx + (8 * op), tl);
+	}
+}
+
+//
+// Bytecode
+//
+
+static void note_start(uint16_t ch_idx, XBOpmSeqChannel *ch, uint8_t len)
+{
+	ch->wait = len;
+	ch->release = len - ((len * ch->gate) >> 3);
+	if (ch->keyed) s_seq.key_off |= 1 << ch_idx;
+	ch->keyed = true;
+	s_seq.key_on |= 1 << ch_idx;
+	macro_start(&ch->vol_macro, SONG_HEADER_VOL_MACROS, ch->vol_macro_id);
+	macro_start(&ch->pitch_macro, SONG_HEADER_PITCH_MACROS, ch->pitch_macro_id);
+}
+
+// Runs commands until the channel has something to wait on.
+static void run_commands(uint16_t ch_idx, XBOpmSeqChannel *ch)
+{
+	for (uint16_t i = 0; i < XB_OPMSEQ_CMD_LIMIT; i++)
+	{
+		s_seq.cmds++;
+		const uint8_t cmd = *ch->pc++;
+		if (cmd <= XB_OPMSEQ_NOTE_MAX)
+		{
+			ch->note = cmd;
+			note_start(ch_idx, ch, *ch->pc++);
+			return;
+		}
+
+		switch (cmd)
+		{
+			case XB_OPMSEQ_REST:
+				ch->wait = *ch->pc++;
+				ch->release = ch->wait;
+				return;
+
+			case XB_OPMSEQ_TIE:
+				ch->wait = *ch->pc++;
+				ch->release = ch->wait - ((ch->wait * ch->gate) >> 3);
+				return;
+
+			default:
+			case XB_OPMSEQ_END:
+				ch->pc = NULL;
+				if (ch->keyed) s_seq.key_off |= 1 << ch_idx;
+				ch->keyed = false;
+				return;
+
+			case XB_OPMSEQ_JUMP:
+				ch->pc = s_seq.song + read16(ch->pc);
+				break;
+
+			case XB_OPMSEQ_LOOP_START:
+				if (ch->loop_sp < XB_OPMSEQ_LOOP_DEPTH)
+				{
+					ch->loop_count[ch->loop_sp] = *ch->pc++;
+					ch->loop_pc[ch->loop_sp] = ch->pc;
+					ch->loop_sp++;
+				}
+				else
+				{
+					ch->pc++;
+				}
+				break;
+
+			case XB_OPMSEQ_LOOP_END:
+				if (ch->loop_sp == 0) break;
+				if (--ch->loop_count[ch->loop_sp - 1] > 0)
+				{
+					ch->pc = ch->loop_pc[ch->loop_sp - 1];
+				}
+				else
+				{
+					ch->loop_sp--;
+				}
+				break;
+
+			case XB_OPMSEQ_INST:
+				load_instrument(ch_idx, ch, *ch->pc++);
+				break;
+
+			case XB_OPMSEQ_VOLUME:
+				ch->volume = *ch->pc++;
+				break;
+
+			case XB_OPMSEQ_PAN:
+				ch->pan = *ch->pc++;
+				set_reg(OPM_CH_PAN_FL_CON + ch_idx, ch->pan | ch->fl_con);
+				break;
+
+			case XB_OPMSEQ_VOL_MACRO:
+				ch->vol_macro_id = *ch->pc++;
+				break;
+
+			case XB_OPMSEQ_PITCH_MACRO:
+				ch->pitch_macro_id = *ch->pc++;
+				break;
+
+			case XB_OPMSEQ_DETUNE:
+				ch->detune = (int8_t)*ch->pc++;
+				break;
+
+			case XB_OPMSEQ_TEMPO:
+				xb_opm_set_clkb_period(*ch->pc++);
+				break;
+
+			case XB_OPMSEQ_GATE:
+				ch->gate = *ch->pc++;
+				break;
+		}
+	}
+}
+
+//
+// Interrupt
+//
+
+static void XB_ISR opmseq_isr(void)
+{
+	// Acknowledge and rearm Timer B.
+	xb_opm_set_timer_flags(OPM_TIMER_FLAG_F_RESET_B | OPM_TIMER_FLAG_IRQ_EN_B |
+	                       OPM_TIMER_FLAG_LOAD_B);
+	xb_opmseq_tick();
+}
+
+//
+// Public interface
+//
+
+void *xb_opmseq_init(void)
+{
+	memset(&s_seq, 0, sizeof(s_seq));
+	s_seq.isr_installed = true;
+	void *prev = xb_mfp_set_interrupt(XB_MFP_INT_FM_SOUND_SOURCE, opmseq_isr);
+	xb_mfp_set_interrupt_enable(XB_MFP_INT_FM_SOUND_SOURCE, true);
+	return prev;
+}
+
+void xb_opmseq_play(const void *song)
+{
+	xb_opmseq_stop();
+
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	s_seq.song = (const uint8_t *)song;
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		XBOpmSeqChannel *ch = &s_seq.ch[i];
+		memset(ch, 0, sizeof(*ch));
+		const uint16_t offs = read16(s_seq.song + SONG_HEADER_TRACKS + (i * 2));
+		ch->pc = offs ? s_seq.song + offs : NULL;
+		ch->gate = 8;
+		ch->pan = OPM_PAN_BOTH;
+		ch->vol_macro_id = MACRO_NONE;
+		ch->pitch_macro_id = MACRO_NONE;
+		ch->kc = 0xFF;
+		ch->kf = 0xFF;
+	}
+	xb_set_ipl(ipl);
+
+	if (s_seq.isr_installed)
+	{
+		xb_opm_set_clkb_period(s_seq.song[2]);
+		xb_opm_set_timer_flags(OPM_TIMER_FLAG_F_RESET_B |
+		                       OPM_TIMER_FLAG_IRQ_EN_B |
+		                       OPM_TIMER_FLAG_LOAD_B);
+	}
+}
+
+void xb_opmseq_stop(void)
+{
+	if (s_seq.isr_installed)
+	{
+		xb_opm_set_timer_flags(OPM_TIMER_FLAG_F_RESET_B);
+	}
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		XBOpmSeqChannel *ch = &s_seq.ch[i];
+		if (ch->keyed) xb_opmvoice_music_key_on(i, 0);
+		ch->keyed = false;
+		ch->pc = NULL;
+	}
+	s_seq.song = NULL;
+}
+
+bool xb_opmseq_is_playing(void)
+{
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		if (s_seq.ch[i].pc) return true;
+	}
+	return false;
+}
+
+void xb_opmseq_tick(void)
+{
+	if (!s_seq.song) return;
+	s_seq.cmds = 0;
+	s_seq.writes = 0;
+	s_seq.key_on = 0;
+	s_seq.key_off = 0;
+
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		XBOpmSeqChannel *ch = &s_seq.ch[i];
+		if (!ch->pc) continue;
+		if (ch->wait > 0) ch->wait--;
+		if (ch->wait == 0) run_commands(i, ch);
+		if (!ch->pc) continue;
+
+		if (ch->keyed && ch->wait <= ch->release && ch->release > 0 &&
+		    !(s_seq.key_on & (1 << i)))
+		{
+			s_seq.key_off |= 1 << i;
+			ch->keyed = false;
+		}
+
+		macro_step(&ch->vol_macro);
+		macro_step(&ch->pitch_macro);
+		update_output(i, ch);
+	}
+
+	// Notes that are retriggered or released go off before the new data is
+	// sent, and new notes go on after it.
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		if (s_seq.key_off & (1 << i)) xb_opmvoice_music_key_on(i, 0);
+	}
+	xb_opm_commit();
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		if (s_seq.key_on & (1 << i)) xb_opmvoice_music_key_on(i, 0x0F);
+	}
+
+	s_seq.stats.ticks++;
+	if (s_seq.cmds > s_seq.stats.max_cmds) s_seq.stats.max_cmds = s_seq.cmds;
+	if (s_seq.writes > s_seq.stats.max_writes)
+	{
+		s_seq.stats.max_writes = s_seq.writes;
+	}
+}
+
+void xb_opmseq_get_stats(XBOpmSeqStats *out)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	*out = s_seq.stats;
+	memset(&s_seq.stats, 0, sizeof(s_seq.stats));
+	xb_set_ipl(ipl);
+}
@@ -0,0 +1,111 @@
+#pragma once
+// XBase OPM Music Sequencer (opmseq)
+// (c) Michael Moffitt 2024
+//
+// Plays songs compiled by tools/mml2opm from MML text. The song is stepped by
+// the OPM's Timer B interrupt (XB_MFP_INT_FM_SOUND_SOURCE), so playback does
+// not depend on the frame rate. Each tick, register changes are made through
+// xb_opm_set() and sent in one batch with xb_opm_commit(). Key on and key off
+// are written directly around the commit, so a new note starts with its
+// frequency and levels already in place.
+//
+// While the sequencer is playing from the interrupt, other code must not call
+// xb_opm_commit(), as the register cache is shared. Other code may still write
+// registers with xb_opm_write() and the helpers built on it (key on, LFO,
+// noise), which mask interrupts between the address and the data, so the
+// interrupt's writes can not come in between. Writes go through
+// xb_opmvoice_music_set(), so sound effects may borrow channels (see opmvoice).
+//
+// Per tick, each channel executes at most XB_OPMSEQ_CMD_LIMIT commands before
+// it waits for the next tick, which bounds the time spent in the interrupt.
+// xb_opmseq_get_stats() reports the most commands and register writes seen in
+// a single tick, which are what the tick time scales with.
+//
+// Song data layout (all values big-endian, offsets from the start of the song):
+//
+//   $00 'O', 'S'    magic
+//   $02 uint8_t     Timer B period
+//   $03 uint8_t     Ticks per quarter note (informational)
+//   $04 uint16_t[8] Channel track offsets (0 = unused)
+//   $14 uint16_t    Instrument table offset (XB_OPMSEQ_INST_BYTES each)
+//   $16 uint16_t    Volume macro table offset (uint16_t offsets to macros)
+//   $18 uint16_t    Pitch macro table offset (uint16_t offsets to macros)
+//   $1A             Data
+//
+// A macro is a length byte, a loop index byte ($FF to hold the last value),
+// and then that many signed values, one used per tick from the start of the
+// note. A loop index at or past the length also holds the last value. Volume
+// macro values are added to the carrier total levels, and pitch macro values
+// are added to the pitch in 1/64 semitone units.
+//
+// An instrument is an XBOpmPatch (see opm.h), loaded with
+// xb_opm_load_patch() so that registers which already match are not sent.
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#include "xbase/opm.h"
+#endif
+
+// Track bytecode.
+// $00 - $5F: Note number (12 * octave + semitone, C = 0), followed by length.
+#define XB_OPMSEQ_NOTE_MAX   0x5F
+#define XB_OPMSEQ_REST       0x60  // length
+#define XB_OPMSEQ_TIE        0x61  // length; extends the note without key on
+#define XB_OPMSEQ_END        0x80  // stops the channel
+#define XB_OPMSEQ_JUMP       0x81  // offset (16-bit, from song start)
+#define XB_OPMSEQ_LOOP_START 0x82  // count
+#define XB_OPMSEQ_LOOP_END   0x83  // jumps back to the start until count runs out
+#define XB_OPMSEQ_INST       0x84  // instrument index
+#define XB_OPMSEQ_VOLUME     0x85  // attenuation (0 - 127) added to carriers
+#define XB_OPMSEQ_PAN        0x86  // OPM_PAN_* value
+#define XB_OPMSEQ_VOL_MACRO  0x87  // macro index, or $FF for none
+#define XB_OPMSEQ_PITCH_MACRO 0x88  // macro index, or $FF for none
+#define XB_OPMSEQ_DETUNE     0x89  // signed, 1/64 semitone units
+#define XB_OPMSEQ_TEMPO      0x8A  // Timer B period
+#define XB_OPMSEQ_GATE       0x8B  // portion of a note to hold, in 8ths (1 - 8)
+
+#define XB_OPMSEQ_INST_BYTES 26  // sizeof(XBOpmPatch)
+#define XB_OPMSEQ_LOOP_DEPTH 4
+#define XB_OPMSEQ_CMD_LIMIT 16
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBOpmSeqStats.ticks:		ds.l 1
+XBOpmSeqStats.max_cmds:		ds.w 1
+XBOpmSeqStats.max_writes:	ds.w 1
+XBOpmSeqStats.len:
+
+	.global	xb_opmseq_init
+	.global	xb_opmseq_play
+	.global	xb_opmseq_stop
+	.global	xb_opmseq_is_playing
+	.global	xb_opmseq_tick
+	.global	xb_opmseq_get_stats
+#else
+typedef struct XBOpmSeqStats
+{
+	uint32_t ticks;       // Ticks processed.
+	uint16_t max_cmds;    // Most commands executed in one tick.
+	uint16_t max_writes;  // Most registers changed in one tick.
+} XBOpmSeqStats;
+
+// Installs the OPM interrupt handler. Returns the previous handler.
+void *xb_opmseq_init(void);
+
+// Starts playing a song from the beginning, and starts Timer B.
+void xb_opmseq_play(const void *song);
+
+// Keys off all channels used by the song, and stops Timer B.
+void xb_opmseq_stop(void);
+
+// Returns true while any channel has not reached its end.
+bool xb_opmseq_is_playing(void);
+
+// Steps the song by one tick. This is called from the Timer B interrupt, but
+// may be called directly to drive playback from elsewhere (without calling
+// xb_opmseq_init()).
+void xb_opmseq_tick(void);
+
+// Copies playback statistics to out, and resets them.
+void xb_opmseq_get_stats(XBOpmSeqStats *out);
+#endif
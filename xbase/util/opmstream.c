@@ -0,0 +1,158 @@
+#include "xbase/util/opmstream.h"
+#include "xbase/util/opmvoice.h"
+
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+#include "xbase/opm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+static struct
+{
+	const uint8_t *stream;
+	const uint8_t *pc;     // NULL once the stream has ended.
+	uint32_t loop_offs;
+	uint16_t wait;         // Ticks to skip before reading more commands.
+	bool isr_installed;
+	XBOpmStreamStats stats;
+} s_stream;
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void XB_ISR opmstream_isr(void)
+{
+	// Acknowledge and rearm Timer B.
+	xb_opm_set_timer_flags(OPM_TIMER_FLAG_F_RESET_B | OPM_TIMER_FLAG_IRQ_EN_B |
+	                       OPM_TIMER_FLAG_LOAD_B);
+	xb_opmstream_tick();
+}
+
+void *xb_opmstream_init(void)
+{
+	memset(&s_stream, 0, sizeof(s_stream));
+	s_stream.isr_installed = true;
+	void *prev = xb_mfp_set_interrupt(XB_MFP_INT_FM_SOUND_SOURCE,
+	                                  opmstream_isr);
+	xb_mfp_set_interrupt_enable(XB_MFP_INT_FM_SOUND_SOURCE, true);
+	return prev;
+}
+
+void xb_opmstream_play(const void *stream)
+{
+	xb_opmstream_stop();
+
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	s_stream.stream = (const uint8_t *)stream;
+	s_stream.pc = s_stream.stream + XB_OPMSTREAM_HEADER_BYTES;
+	s_stream.loop_offs = read32(s_stream.stream + 4);
+	s_stream.wait = 0;
+	xb_set_ipl(ipl);
+
+	if (s_stream.isr_installed)
+	{
+		xb_opm_set_clkb_period(s_stream.stream[2]);
+		xb_opm_set_timer_flags(OPM_TIMER_FLAG_F_RESET_B |
+		                       OPM_TIMER_FLAG_IRQ_EN_B |
+		                       OPM_TIMER_FLAG_LOAD_B);
+	}
+}
+
+void xb_opmstream_stop(void)
+{
+	if (s_stream.isr_installed)
+	{
+		xb_opm_set_timer_flags(OPM_TIMER_FLAG_F_RESET_B);
+	}
+	s_stream.pc = NULL;
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		xb_opmvoice_music_key_on(i, 0);
+	}
+}
+
+bool xb_opmstream_is_playing(void)
+{
+	return s_stream.pc != NULL;
+}
+
+void xb_opmstream_tick(void)
+{
+	if (!s_stream.pc) return;
+	s_stream.stats.ticks++;
+	if (s_stream.wait > 0)
+	{
+		s_stream.wait--;
+		return;
+	}
+
+	const uint8_t *pc = s_stream.pc;
+	uint16_t writes = 0;
+	for (uint16_t i = 0; i < XB_OPMSTREAM_CMD_LIMIT; i++)
+	{
+		const uint8_t cmd = *pc++;
+		if (cmd >= XB_OPMSTREAM_SET_MIN)
+		{
+			xb_opmvoice_music_set(cmd, *pc++);
+			writes++;
+			continue;
+		}
+
+		switch (cmd)
+		{
+			case XB_OPMSTREAM_WAIT:
+				// vgm2opm does not write a wait of 0; play it as 1.
+				s_stream.wait = *pc++;
+				if (s_stream.wait > 0) s_stream.wait--;
+				goto done;
+
+			case XB_OPMSTREAM_KEY:
+				xb_opmvoice_music_key_on(*pc & 0x07, *pc >> 3);
+				pc++;
+				writes++;
+				break;
+
+			case XB_OPMSTREAM_DIRECT:
+				xb_opm_write(pc[0], pc[1]);
+				pc += 2;
+				writes++;
+				break;
+
+			case XB_OPMSTREAM_COMMIT:
+				xb_opm_commit();
+				break;
+
+			case XB_OPMSTREAM_LOOP:
+				if (s_stream.loop_offs)
+				{
+					pc = s_stream.stream + s_stream.loop_offs;
+					s_stream.stats.loops++;
+					break;
+				}
+				// Fall through to the end without a loop point.
+			default:
+			case XB_OPMSTREAM_END:
+				pc = NULL;
+				goto done;
+		}
+	}
+	// Out of commands for this tick; the rest run on the next one.
+	s_stream.stats.cmd_limits++;
+
+done:
+	s_stream.pc = pc;
+	s_stream.stats.writes += writes;
+	if (writes > s_stream.stats.max_writes) s_stream.stats.max_writes = writes;
+}
+
+void xb_opmstream_get_stats(XBOpmStreamStats *out)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	*out = s_stream.stats;
+	memset(&s_stream.stats, 0, sizeof(s_stream.stats));
+	xb_set_ipl(ipl);
+}
@@ -0,0 +1,107 @@
+#pragma once
+// XBase OPM Register Stream Player (opmstream)
+// (c) Michael Moffitt 2024
+//
+// Plays register streams converted from VGM by tools/vgm2opm. The converter
+// has already removed writes that do not change anything and grouped the
+// rest by player tick, so the player only has to hand each tick's writes to
+// the register cache with xb_opm_set() and send them with xb_opm_commit().
+//
+// Like opmseq, the stream is stepped by the OPM's Timer B interrupt, and the
+// two can not play at the same time. While a stream is playing from the
+// interrupt, other code must not call xb_opm_commit(), but may use
+// xb_opm_write() and its helpers, which are masked against the interrupt. As
+// with opmseq, writes go through xb_opmvoice_music_set(), so effects may
+// borrow channels.
+//
+// Each tick runs at most XB_OPMSTREAM_CMD_LIMIT commands, and any left over
+// run on the next tick, which bounds the time spent in the interrupt (and
+// keeps a stream that loops without a wait from hanging it). The converter's
+// busiest ticks, a full register restore at the loop point, stay under it.
+//
+// Key on writes are ordered by the converter around the commit: channels that
+// go off (or retrigger) during a tick are keyed off before the commit, and
+// new notes are keyed on after it.
+//
+// Stream layout (big-endian, offsets from the start of the stream):
+//
+//   $00 'V', 'S'  magic
+//   $02 uint8_t   Timer B period
+//   $03 uint8_t   (reserved)
+//   $04 uint32_t  Loop offset (0 = no loop)
+//   $08 uint32_t  Length in ticks
+//   $0C           Commands
+//
+// Commands:
+//   $20 - $FF dd  Set cached register to dd
+//   $01 n         End of tick; wait n ticks (1 - 255) before the next one
+//   $02 dd        Write dd to the key on register ($08) immediately
+//   $03 rr dd     Write dd to register rr immediately
+//   $04           xb_opm_commit()
+//   $05           Jump to the loop offset
+//   $06           End of stream
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#define XB_OPMSTREAM_WAIT   0x01
+#define XB_OPMSTREAM_KEY    0x02
+#define XB_OPMSTREAM_DIRECT 0x03
+#define XB_OPMSTREAM_COMMIT 0x04
+#define XB_OPMSTREAM_LOOP   0x05
+#define XB_OPMSTREAM_END    0x06
+#define XB_OPMSTREAM_SET_MIN 0x20
+
+#define XB_OPMSTREAM_HEADER_BYTES 0x0C
+
+#ifndef XB_OPMSTREAM_CMD_LIMIT
+#define XB_OPMSTREAM_CMD_LIMIT 256
+#endif
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBOpmStreamStats.ticks:		ds.l 1
+XBOpmStreamStats.writes:	ds.l 1
+XBOpmStreamStats.max_writes:	ds.w 1
+XBOpmStreamStats.loops:		ds.w 1
+XBOpmStreamStats.cmd_limits:	ds.w 1
+XBOpmStreamStats.len:
+
+	.global	xb_opmstream_init
+	.global	xb_opmstream_play
+	.global	xb_opmstream_stop
+	.global	xb_opmstream_is_playing
+	.global	xb_opmstream_tick
+	.global	xb_opmstream_get_stats
+#else
+typedef struct XBOpmStreamStats
+{
+	uint32_t ticks;       // Ticks processed.
+	uint32_t writes;      // Register writes and sets.
+	uint16_t max_writes;  // Most writes and sets in one tick.
+	uint16_t loops;       // Times the stream has looped.
+	uint16_t cmd_limits;  // Ticks cut short by XB_OPMSTREAM_CMD_LIMIT.
+} XBOpmStreamStats;
+
+// Installs the OPM interrupt handler. Returns the previous handler.
+void *xb_opmstream_init(void);
+
+// Starts playing a stream from the beginning, and starts Timer B.
+void xb_opmstream_play(const void *stream);
+
+// Keys off all channels, and stops Timer B.
+void xb_opmstream_stop(void);
+
+// Returns true until a stream without a loop has reached its end.
+bool xb_opmstream_is_playing(void);
+
+// Steps the stream by one tick. This is called from the Timer B interrupt, but
+// may be called directly to drive playback from elsewhere (without calling
+// xb_opmstream_init()).
+void xb_opmstream_tick(void);
+
+// Copies playback statistics to out, and resets them.
+void xb_opmstream_get_stats(XBOpmStreamStats *out);
+#endif
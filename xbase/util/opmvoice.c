@@ -0,0 +1,190 @@
+#include "xbase/util/opmvoice.h"
+
+#include "xbase/ipl.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// Channel registers are $20 + (8 * n) + channel, so the image index is the
+// register number divided by 8, less four.
+#define REG_INDEX(addr) (((addr) >> 3) - 4)
+#define INDEX_REG(i, ch) ((((i) + 4) << 3) | (ch))
+
+volatile uint8_t g_xb_opmvoice_stolen;
+
+typedef struct XBOpmVoiceChannel
+{
+	uint8_t prio;     // Effect priority, or XB_OPMVOICE_PRIO_FREE.
+	uint16_t gen;     // Incremented on each claim, to expire old handles.
+	uint16_t age;     // Claim order, to pick the oldest effect to steal.
+	uint8_t music_image[XB_OPMVOICE_CH_REGS];
+} XBOpmVoiceChannel;
+
+static XBOpmVoiceChannel s_ch[XB_OPM_VOICE_COUNT];
+static uint8_t s_music_mask;
+static uint8_t s_music_prio;
+static uint16_t s_age;
+
+static inline int16_t make_handle(uint16_t ch)
+{
+	return ((s_ch[ch].gen & 0x0FFF) << 3) | ch;
+}
+
+static void steal_music(uint16_t ch)
+{
+	// Take the channel's image from the cache as the music left it. Pending
+	// data counts as well, as the music has already asked for it.
+	uint8_t *image = s_ch[ch].music_image;
+	for (uint16_t i = 0; i < XB_OPMVOICE_CH_REGS; i++)
+	{
+		image[i] = g_xb_opm_reg_cache[INDEX_REG(i, ch)] & 0xFF;
+	}
+	g_xb_opmvoice_stolen |= 1 << ch;
+	xb_opm_set_key_on(ch, 0);
+}
+
+static int16_t restore_music(uint16_t ch)
+{
+	const uint8_t *image = s_ch[ch].music_image;
+	int16_t count = 0;
+	for (uint16_t i = 0; i < XB_OPMVOICE_CH_REGS; i++)
+	{
+		const uint8_t addr = INDEX_REG(i, ch);
+		const uint16_t cached = g_xb_opm_reg_cache[addr];
+		if ((cached & (XB_OPM_CACHE_PENDING | XB_OPM_CACHE_SENT)) &&
+		    (cached & 0xFF) == image[i])
+		{
+			continue;
+		}
+		xb_opm_set(addr, image[i]);
+		count++;
+	}
+	g_xb_opmvoice_stolen &= ~(1 << ch);
+	return count;
+}
+
+void xb_opmvoice_init(void)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	memset(s_ch, 0, sizeof(s_ch));
+	g_xb_opmvoice_stolen = 0;
+	s_music_mask = 0;
+	s_music_prio = XB_OPMVOICE_PRIO_FREE;
+	s_age = 0;
+	xb_set_ipl(ipl);
+}
+
+void xb_opmvoice_set_music(uint8_t channel_mask, uint8_t prio)
+{
+	s_music_mask = channel_mask;
+	s_music_prio = prio;
+}
+
+int16_t xb_opmvoice_claim(uint8_t prio, uint8_t channel_mask)
+{
+	if (prio == XB_OPMVOICE_PRIO_FREE) return -1;
+
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	int16_t free_ch = -1;
+	int16_t music_ch = -1;
+	int16_t effect_ch = -1;
+	for (uint16_t i = 0; i < XB_OPM_VOICE_COUNT; i++)
+	{
+		if (!(channel_mask & (1 << i))) continue;
+		const XBOpmVoiceChannel *c = &s_ch[i];
+		if (c->prio != XB_OPMVOICE_PRIO_FREE)
+		{
+			if (c->prio >= prio) continue;
+			if (effect_ch < 0 || c->prio < s_ch[effect_ch].prio ||
+			    (c->prio == s_ch[effect_ch].prio &&
+			     (int16_t)(c->age - s_ch[effect_ch].age) < 0))
+			{
+				effect_ch = i;
+			}
+		}
+		else if (s_music_mask & (1 << i))
+		{
+			if (s_music_prio < prio && music_ch < 0) music_ch = i;
+		}
+		else if (free_ch < 0)
+		{
+			free_ch = i;
+		}
+	}
+
+	int16_t ch = free_ch;
+	if (ch < 0)
+	{
+		ch = music_ch;
+		if (ch >= 0) steal_music(ch);
+	}
+	if (ch < 0)
+	{
+		// The effect loses its channel; the music image, if any, is kept.
+		ch = effect_ch;
+		if (ch >= 0) xb_opm_set_key_on(ch, 0);
+	}
+
+	int16_t handle = -1;
+	if (ch >= 0)
+	{
+		XBOpmVoiceChannel *c = &s_ch[ch];
+		c->prio = prio;
+		c->gen++;
+		c->age = s_age++;
+		handle = make_handle(ch);
+	}
+	xb_set_ipl(ipl);
+	return handle;
+}
+
+int16_t xb_opmvoice_release(int16_t handle)
+{
+	if (handle < 0) return -1;
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	const uint16_t ch = xb_opmvoice_get_channel(handle);
+	int16_t ret = -1;
+	if (s_ch[ch].prio != XB_OPMVOICE_PRIO_FREE && make_handle(ch) == handle)
+	{
+		xb_opm_set_key_on(ch, 0);
+		s_ch[ch].prio = XB_OPMVOICE_PRIO_FREE;
+		ret = (g_xb_opmvoice_stolen & (1 << ch)) ? restore_music(ch) : 0;
+	}
+	xb_set_ipl(ipl);
+	return ret;
+}
+
+bool xb_opmvoice_is_valid(int16_t handle)
+{
+	if (handle < 0) return false;
+	const uint16_t ch = xb_opmvoice_get_channel(handle);
+	return s_ch[ch].prio != XB_OPMVOICE_PRIO_FREE && make_handle(ch) == handle;
+}
+
+bool xb_opmvoice_key_on(int16_t handle, uint8_t sn)
+{
+	if (handle < 0) return false;
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	const bool valid = xb_opmvoice_is_valid(handle);
+	if (valid) xb_opm_set_key_on(xb_opmvoice_get_channel(handle), sn);
+	xb_set_ipl(ipl);
+	return valid;
+}
+
+void xb_opmvoice_save_music(uint8_t addr, uint8_t data)
+{
+	s_ch[addr & 0x07].music_image[REG_INDEX(addr)] = data;
+}
+
+void xb_opmvoice_save_music_patch(uint8_t channel, const XBOpmPatch *patch)
+{
+	uint8_t *image = s_ch[channel].music_image;
+	const uint8_t *src = (const uint8_t *)patch;
+	image[REG_INDEX(OPM_CH_PAN_FL_CON)] =
+	    (image[REG_INDEX(OPM_CH_PAN_FL_CON)] & OPM_PAN_BOTH) | patch->fl_con;
+	// The rest of the patch is in register order from PMS / AMS onwards.
+	for (uint16_t i = REG_INDEX(OPM_CH_PMS_AMS); i < XB_OPMVOICE_CH_REGS; i++)
+	{
+		image[i] = *++src;
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+// XBase OPM Voice Allocator (opmvoice)
+// (c) Michael Moffitt 2024
+//
+// Shares the eight OPM channels between music and sound effects.
+//
+// Music declares the channels it uses with xb_opmvoice_set_music(). A sound
+// effect asks for a channel with xb_opmvoice_claim(), giving a priority; it
+// receives a free channel if there is one, or else steals a music channel or
+// a lower priority effect's channel.
+//
+// When a music channel is stolen, its register image is copied out of
+// g_xb_opm_reg_cache. Music writes made through xb_opmvoice_music_set() while
+// the channel is stolen update that copy instead of the chip, and its key on
+// writes (xb_opmvoice_music_key_on()) are dropped. When the effect releases
+// the channel, only the registers where the effect left a different value are
+// set back, so a short effect on a similar patch costs few writes.
+//
+// The effect sets its channel's registers with the normal xb_opm_set()
+// functions. As with the music, the data is sent by the next xb_opm_commit()
+// (the music's, while it plays from an interrupt). Key on and key off are not
+// cached, and the music writes the key on register directly, so the effect
+// keys its channel with xb_opmvoice_key_on() rather than through the cache;
+// it should do so once its data has been sent.
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/opm.h"
+#endif
+
+// Registers that belong to one channel: four channel registers, and six for
+// each of the four operators.
+#define XB_OPMVOICE_CH_REGS (4 + (6 * XB_OPM_OP_COUNT))
+
+#define XB_OPMVOICE_PRIO_FREE 0
+
+#ifdef __ASSEMBLER__
+	.global	g_xb_opmvoice_stolen
+	.global	xb_opmvoice_init
+	.global	xb_opmvoice_set_music
+	.global	xb_opmvoice_claim
+	.global	xb_opmvoice_release
+	.global	xb_opmvoice_is_valid
+	.global	xb_opmvoice_key_on
+	.global	xb_opmvoice_save_music
+	.global	xb_opmvoice_save_music_patch
+#else
+// Bit n is set while music channel n is held by an effect.
+extern volatile uint8_t g_xb_opmvoice_stolen;
+
+// Clears all claims and marks every channel free.
+void xb_opmvoice_init(void);
+
+// Sets which channels the music uses, and the priority an effect needs to
+// exceed to steal one of them.
+void xb_opmvoice_set_music(uint8_t channel_mask, uint8_t prio);
+
+// Claims a channel from channel_mask for an effect of priority prio (1 or
+// higher). Free channels are used first, then music channels, then the oldest
+// effect of the lowest priority below prio.
+// Returns a handle, or -1 if every channel is held at prio or above.
+int16_t xb_opmvoice_claim(uint8_t prio, uint8_t channel_mask);
+
+// Keys off the effect's channel and returns it. A stolen music channel has
+// its registers set back.
+// Returns the number of registers set, or -1 if the handle is no longer valid
+// (the channel was taken by a higher priority effect).
+int16_t xb_opmvoice_release(int16_t handle);
+
+// Returns true while the handle still holds its channel.
+bool xb_opmvoice_is_valid(int16_t handle);
+
+// Writes key on for the effect's channel; sn is the slot mask (0 - 15, 0 for
+// key off). Interrupts are masked so that the music can not take the write's
+// place, or the channel, in between.
+// Returns false, writing nothing, if the handle is no longer valid.
+bool xb_opmvoice_key_on(int16_t handle, uint8_t sn);
+
+// Returns the OPM channel (0 - 7) for a handle.
+static inline uint8_t xb_opmvoice_get_channel(int16_t handle);
+
+// Stores a music register write for a stolen channel. Used by
+// xb_opmvoice_music_set().
+void xb_opmvoice_save_music(uint8_t addr, uint8_t data);
+
+// Stores a music patch load for a stolen channel. Used by
+// xb_opmvoice_music_load_patch().
+void xb_opmvoice_save_music_patch(uint8_t channel, const XBOpmPatch *patch);
+
+// Music drivers should write through these, so that writes to stolen channels
+// are held back.
+static inline void xb_opmvoice_music_set(uint8_t addr, uint8_t data);
+static inline void xb_opmvoice_music_key_on(uint8_t channel, uint8_t sn);
+static inline uint16_t xb_opmvoice_music_load_patch(uint8_t channel,
+                                                    const XBOpmPatch *patch);
+
+//
+// Static implementations
+//
+
+static inline uint8_t xb_opmvoice_get_channel(int16_t handle)
+{
+	return handle & 0x07;
+}
+
+static inline void xb_opmvoice_music_set(uint8_t addr, uint8_t data)
+{
+	if (addr >= OPM_CH_PAN_FL_CON &&
+	    (g_xb_opmvoice_stolen & (1 << (addr & 0x07))))
+	{
+		xb_opmvoice_save_music(addr, data);
+		return;
+	}
+	xb_opm_set(addr, data);
+}
+
+static inline void xb_opmvoice_music_key_on(uint8_t channel, uint8_t sn)
+{
+	if (g_xb_opmvoice_stolen & (1 << channel)) return;
+	xb_opm_set_key_on(channel, sn);
+}
+
+static inline uint16_t xb_opmvoice_music_load_patch(uint8_t channel,
+                                                    const XBOpmPatch *patch)
+{
+	if (g_xb_opmvoice_stolen & (1 << channel))
+	{
+		xb_opmvoice_save_music_patch(channel, patch);
+		return 0;
+	}
+	return xb_opm_load_patch(channel, patch);
+}
+#endif
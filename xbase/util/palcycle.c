@@ -0,0 +1,92 @@
+#include "xbase/util/palcycle.h"
+
+#include <string.h>
+
+#define PAL_ENTRY_COUNT 16
+#define PAL_LINES 32
+
+typedef struct XBPalCycle
+{
+	uint16_t *last;    // Last entry in g_xb_pal_buffer.
+	uint32_t row_bit;  // Bit for xb_pal_mark().
+	uint16_t span;     // Entry count minus one.
+	uint16_t dir;
+	uint16_t period;   // Zero for unused slots.
+	uint16_t timer;    // Frames until the next step.
+} XBPalCycle;
+
+static XBPalCycle s_cycles[XB_PALCYCLE_COUNT];
+
+void xb_palcycle_init(void)
+{
+	memset(s_cycles, 0, sizeof(s_cycles));
+}
+
+int16_t xb_palcycle_add(uint16_t row, uint16_t first, uint16_t last,
+                        uint16_t dir, uint16_t period)
+{
+	if (row >= PAL_LINES) return -1;
+	if (last >= PAL_ENTRY_COUNT || first >= last) return -1;
+	if (period == 0) return -1;
+
+	for (int16_t i = 0; i < XB_PALCYCLE_COUNT; i++)
+	{
+		XBPalCycle *c = &s_cycles[i];
+		if (c->period) continue;
+		c->last = &g_xb_pal_buffer[(row * PAL_ENTRY_COUNT) + last];
+		c->row_bit = (uint32_t)1 << row;
+		c->span = last - first;
+		c->dir = dir;
+		c->period = period;
+		c->timer = period;
+		return i;
+	}
+	return -1;
+}
+
+void xb_palcycle_remove(int16_t id)
+{
+	if (id < 0 || id >= XB_PALCYCLE_COUNT) return;
+	s_cycles[id].period = 0;
+}
+
+void xb_palcycle_poll(void)
+{
+	uint32_t mark = 0;
+	for (uint16_t i = 0; i < XB_PALCYCLE_COUNT; i++)
+	{
+		XBPalCycle *c = &s_cycles[i];
+		if (!c->period) continue;
+		if (--c->timer) continue;
+		c->timer = c->period;
+		mark |= c->row_bit;
+
+		uint16_t *p = c->last;
+		uint16_t n = c->span;
+		if (c->dir == XB_PALCYCLE_DIR_FORWARD)
+		{
+			// Shift entries up, and wrap the last entry around to the first.
+			const uint16_t wrap = *p;
+			while (n--)
+			{
+				*p = *(p - 1);
+				p--;
+			}
+			*p = wrap;
+		}
+		else
+		{
+			// Shift entries down, and wrap the first entry around to the last.
+			p -= n;
+			const uint16_t wrap = *p;
+			while (n--)
+			{
+				*p = *(p + 1);
+				p++;
+			}
+			*p = wrap;
+		}
+	}
+
+	if (mark) xb_pal_mark(mark);
+}
@@ -0,0 +1,55 @@
+#pragma once
+// XBase Palette Cycling (palcycle)
+// (c) Michael Moffitt 2024
+//
+// Rotates ranges of palette entries within g_xb_pal_buffer, for waterfalls,
+// lava, conveyor belts, and so on.
+//
+// Register a range with xb_palcycle_add(), and then call xb_palcycle_poll()
+// once per frame before xb_pal_commit(). Each range rotates by one entry
+// whenever its period has elapsed, and only the rows that were rotated are
+// marked for transfer.
+//
+// Entries are rotated in place, so the colors in g_xb_pal_buffer may still be
+// replaced with xb_pal_set() while a range is cycling.
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#include "xbase/pal.h"
+#endif
+
+// Maximum number of ranges that may be registered at once.
+#define XB_PALCYCLE_COUNT 32
+
+// Rotation directions.
+#define XB_PALCYCLE_DIR_FORWARD  0  // Colors move towards the last entry.
+#define XB_PALCYCLE_DIR_BACKWARD 1  // Colors move towards the first entry.
+
+#ifdef __ASSEMBLER__
+	.global	xb_palcycle_init
+	.global	xb_palcycle_add
+	.global	xb_palcycle_remove
+	.global	xb_palcycle_poll
+#else
+
+// Removes all ranges.
+void xb_palcycle_init(void);
+
+// Registers a range of entries to rotate.
+// row:    palette row (0 - 31, see pal.h)
+// first:  first entry in the range (0 - 15)
+// last:   last entry in the range (first + 1 - 15)
+// dir:    XB_PALCYCLE_DIR_*
+// period: frames between each step (1 or more)
+// Returns an ID for xb_palcycle_remove(), or -1 if no slot was free or the
+// parameters are invalid.
+int16_t xb_palcycle_add(uint16_t row, uint16_t first, uint16_t last,
+                        uint16_t dir, uint16_t period);
+
+// Stops a range from cycling. Its colors are left as they are.
+void xb_palcycle_remove(int16_t id);
+
+// Steps any ranges that are due and marks their rows. Call once per frame.
+void xb_palcycle_poll(void);
+
+#endif
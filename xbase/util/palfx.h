@@ -0,0 +1,79 @@
+#pragma once
+// XBase Palette Effects (palfx)
+// (c) Michael Moffitt 2024
+//
+// Fades and cross-fades that operate on g_xb_pal_buffer.
+//
+// A fade works between two palettes: the source, which is a saved copy of
+// rows taken from g_xb_pal_buffer, and the target, which is either another
+// palette or a single solid color. xb_palfx_blend() writes a mix of the two
+// into g_xb_pal_buffer for the rows requested and marks them with
+// xb_pal_mark(), so they go out with the next xb_pal_commit().
+//
+// Both palettes are stored pre-split into their R, G, and B components, and
+// mixing is done with lookup tables built by xb_palfx_init(). No multiplies
+// or shifts are done per color, so a sixteen-row blend is a small part of a
+// frame and it is fine to call xb_palfx_blend() every frame during a fade.
+//
+// Rows are specified with the same bitfield format as xb_pal_mark().
+//
+// Example (fade the PCG palettes to black over sixteen frames):
+//
+//  xb_palfx_save(0xFFFF0000);
+//  xb_palfx_target_black(0xFFFF0000);
+//  for (uint16_t i = 0; i <= XB_PALFX_LEVELS; i++)
+//  {
+//      xb_palfx_blend(0xFFFF0000, i);
+//      xb_vbl_wait();
+//      xb_pal_commit();
+//  }
+//
+// The intensity bit (bit 0) is not mixed; it is taken from whichever palette
+// is weighted more heavily, and is clear at the exact midpoint.
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#include "xbase/pal.h"
+#include "xbase/vidcon.h"
+#endif
+
+// Number of steps between the source (level 0) and target (this value).
+#define XB_PALFX_LEVELS 16
+
+#ifdef __ASSEMBLER__
+	.global	xb_palfx_init
+	.global	xb_palfx_save
+	.global	xb_palfx_set_target
+	.global	xb_palfx_fill_target
+	.global	xb_palfx_blend
+#else
+
+// Builds the blend tables and clears the source and target palettes.
+void xb_palfx_init(void);
+
+// Copies rows from g_xb_pal_buffer to serve as the fade source.
+void xb_palfx_save(uint32_t row_bitfield);
+
+// Sets one row of the target palette from 16 colors of palette data, for
+// cross-fading to a different palette.
+void xb_palfx_set_target(uint16_t row, const void *src);
+
+// Sets rows of the target palette to a single color.
+void xb_palfx_fill_target(uint32_t row_bitfield, uint16_t color);
+
+// Mixes the source and target into g_xb_pal_buffer for the selected rows, and
+// marks those rows for transfer.
+// level: 0 (source) - XB_PALFX_LEVELS (target). Larger values are clamped.
+void xb_palfx_blend(uint32_t row_bitfield, uint16_t level);
+
+static inline void xb_palfx_target_black(uint32_t row_bitfield)
+{
+	xb_palfx_fill_target(row_bitfield, XB_PAL_RGB5(0, 0, 0));
+}
+
+static inline void xb_palfx_target_white(uint32_t row_bitfield)
+{
+	xb_palfx_fill_target(row_bitfield, XB_PAL_RGB5(0x1F, 0x1F, 0x1F) | 0x0001);
+}
+
+#endif
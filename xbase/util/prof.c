@@ -0,0 +1,195 @@
+#include "xbase/util/prof.h"
+
+#ifdef XB_PROF_RASTER
+
+uint16_t g_xb_prof_raster_color;
+uint16_t g_xb_prof_raster_prev[XB_PROF_ZONES];
+uint16_t g_xb_prof_raster_colors[XB_PROF_ZONES];
+
+const uint16_t g_xb_prof_raster_defaults[8] =
+{
+	XB_PAL_RGB5(31, 0, 0),
+	XB_PAL_RGB5(0, 31, 0),
+	XB_PAL_RGB5(0, 0, 31),
+	XB_PAL_RGB5(31, 31, 0),
+	XB_PAL_RGB5(31, 0, 31),
+	XB_PAL_RGB5(0, 31, 31),
+	XB_PAL_RGB5(31, 16, 0),
+	XB_PAL_RGB5(16, 16, 16),
+};
+
+void xb_prof_set_color(uint16_t zone, uint16_t color)
+{
+	g_xb_prof_raster_colors[zone] = color;
+}
+
+#endif  // XB_PROF_RASTER
+
+#ifdef XB_PROF
+
+#include "xbase/ipl.h"
+#include "xbase/mfp.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+volatile uint32_t g_xb_prof_wraps;
+volatile uint32_t g_xb_prof_pend_reads;
+uint32_t g_xb_prof_zone_start[XB_PROF_ZONES];
+uint32_t g_xb_prof_zone_ticks[XB_PROF_ZONES];
+
+typedef struct XBProfFrame
+{
+	uint16_t frame;                 // Ticks since the previous frame.
+	uint16_t zone[XB_PROF_ZONES];   // Ticks per zone.
+	uint16_t pend_reads;            // Readings with a wrap pending.
+} XBProfFrame;
+
+static struct
+{
+	XBProfFrame history[XB_PROF_HISTORY];
+	uint16_t head;                  // Next entry to write.
+	uint16_t count;                 // Entries written, up to XB_PROF_HISTORY.
+	uint32_t frames;                // Frames seen in total.
+	uint32_t frame_start;
+	uint32_t frame_pend_reads;      // g_xb_prof_pend_reads at frame_start.
+	const char *names[XB_PROF_ZONES];
+	void *prev_isr;
+	XBMfpTimerState prev_timer;     // Human68k's setting, for shutdown.
+} s_prof;
+
+static void XB_ISR prof_isr(void)
+{
+	g_xb_prof_wraps++;
+}
+
+static inline uint16_t saturate16(uint32_t v)
+{
+	return (v > 0xFFFF) ? 0xFFFF : v;
+}
+
+void *xb_prof_init(void)
+{
+	// Read before masking, as finding the reload waits for the timer to wrap.
+	XBMfpTimerState prev_timer;
+	xb_mfp_save_timer(XB_PROF_TIMER, &prev_timer);
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	memset(&s_prof, 0, sizeof(s_prof));
+	s_prof.prev_timer = prev_timer;
+	memset(g_xb_prof_zone_ticks, 0, sizeof(g_xb_prof_zone_ticks));
+	g_xb_prof_wraps = 0;
+	g_xb_prof_pend_reads = 0;
+	s_prof.prev_isr = xb_mfp_set_interrupt(XB_PROF_VECTOR, prof_isr);
+	xb_mfp_set_timer(XB_PROF_TIMER, XB_PROF_PRESCALE, 0);
+	xb_mfp_set_interrupt_enable(XB_PROF_VECTOR, true);
+	xb_set_ipl(ipl);
+	s_prof.frame_start = xb_prof_now();
+	return s_prof.prev_isr;
+}
+
+void xb_prof_shutdown(void)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	xb_mfp_set_interrupt(XB_PROF_VECTOR, s_prof.prev_isr);
+	xb_mfp_restore_timer(XB_PROF_TIMER, &s_prof.prev_timer);
+	xb_set_ipl(ipl);
+}
+
+void xb_prof_set_name(uint16_t zone, const char *name)
+{
+	s_prof.names[zone] = name;
+}
+
+void xb_prof_frame(void)
+{
+	const uint32_t now = xb_prof_now();
+	XBProfFrame *f = &s_prof.history[s_prof.head];
+	f->frame = saturate16(now - s_prof.frame_start);
+	s_prof.frame_start = now;
+	const uint32_t pend_reads = g_xb_prof_pend_reads;
+	f->pend_reads = saturate16(pend_reads - s_prof.frame_pend_reads);
+	s_prof.frame_pend_reads = pend_reads;
+	for (uint16_t i = 0; i < XB_PROF_ZONES; i++)
+	{
+		f->zone[i] = saturate16(g_xb_prof_zone_ticks[i]);
+		g_xb_prof_zone_ticks[i] = 0;
+	}
+	s_prof.head = (s_prof.head + 1) % XB_PROF_HISTORY;
+	if (s_prof.count < XB_PROF_HISTORY) s_prof.count++;
+	s_prof.frames++;
+}
+
+static inline const XBProfFrame *history_entry(uint16_t i)
+{
+	// i counts from the oldest entry kept.
+	const uint16_t oldest = (s_prof.head + XB_PROF_HISTORY - s_prof.count) %
+	                        XB_PROF_HISTORY;
+	return &s_prof.history[(oldest + i) % XB_PROF_HISTORY];
+}
+
+// zone is -1 for the frame length.
+static void dump_line(FILE *f, const char *name, int16_t zone)
+{
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	uint32_t sum = 0;
+	for (uint16_t i = 0; i < s_prof.count; i++)
+	{
+		const XBProfFrame *e = history_entry(i);
+		const uint16_t v = (zone < 0) ? e->frame : e->zone[zone];
+		if (v < min) min = v;
+		if (v > max) max = v;
+		sum += v;
+	}
+	fprintf(f, "%-16s %6u %6lu %6u\n", name, min,
+	        (unsigned long)(sum / s_prof.count), max);
+}
+
+bool xb_prof_dump(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) return false;
+
+	fprintf(f, "%lu frames, last %u kept, %u ns per tick\n",
+	        (unsigned long)s_prof.frames, s_prof.count, XB_PROF_TICK_NS);
+	if (g_xb_prof_pend_reads)
+	{
+		fprintf(f, "%lu readings found a timer wrap pending; times that "
+		        "include one are short if the wrap was held off for over "
+		        "256 ticks\n", (unsigned long)g_xb_prof_pend_reads);
+	}
+	if (s_prof.count > 0)
+	{
+		fprintf(f, "%-16s %6s %6s %6s\n", "zone", "min", "avg", "max");
+		dump_line(f, "(frame)", -1);
+		for (uint16_t i = 0; i < XB_PROF_ZONES; i++)
+		{
+			if (!s_prof.names[i]) continue;
+			dump_line(f, s_prof.names[i], i);
+		}
+
+		fprintf(f, "\nframe");
+		for (uint16_t i = 0; i < XB_PROF_ZONES; i++)
+		{
+			if (s_prof.names[i]) fprintf(f, ",%s", s_prof.names[i]);
+		}
+		fprintf(f, ",pending\n");
+		for (uint16_t i = 0; i < s_prof.count; i++)
+		{
+			const XBProfFrame *e = history_entry(i);
+			fprintf(f, "%u", e->frame);
+			for (uint16_t j = 0; j < XB_PROF_ZONES; j++)
+			{
+				if (s_prof.names[j]) fprintf(f, ",%u", e->zone[j]);
+			}
+			fprintf(f, ",%u\n", e->pend_reads);
+		}
+	}
+
+	const bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+#endif  // XB_PROF
@@ -0,0 +1,273 @@
+#pragma once
+// XBase Profiler (prof)
+// (c) Michael Moffitt 2024
+//
+// Measures how long sections of code take, using an MFP timer as a free
+// running counter. The timer counts down through 256 steps and interrupts on
+// each wrap, where the wrap count is incremented; together they make a 32-bit
+// time in ticks of XB_PROF_TICK_NS.
+//
+// Code to measure is marked as a zone with XB_PROF_BEGIN(zone) and
+// XB_PROF_END(zone), where zone is a number below XB_PROF_ZONES (the program
+// picks its own). Zones may nest or interleave, but one zone may not be begun
+// again before it ends. Time is summed per zone until XB_PROF_FRAME(), which
+// stores the totals, and the length of the frame, in a ring buffer of the last
+// XB_PROF_HISTORY frames. xb_prof_dump() writes the min / avg / max of each zone
+// over those frames to a file.
+//
+// Marking calls to library routines, for example:
+//
+//   XB_PROF_BEGIN(ZONE_SPRITES);
+//   xb_pcg_finish_sprites();
+//   XB_PROF_END(ZONE_SPRITES);
+//
+// Everything is compiled only when XB_PROF is defined; without it, the macros
+// are empty and the functions are not built. Reading the time costs about 100
+// cycles, so a begin / end pair is around 250 with the bookkeeping. The wrap
+// interrupt comes every 256 ticks (about 65 times a frame at the default 1us
+// tick) and costs about 60 cycles each time, or some 2% of the CPU.
+//
+// The wrap interrupt is held off while the IPL is raised, and while any other
+// MFP handler runs (they share one level), such as a vertical blank handler
+// committing sprites or the palette. A wrap in that time shows as pending and
+// is still counted, but only one can: a hold-off longer than 256 ticks (256us
+// at the default tick) loses 256 ticks per extra wrap, and zones timed across
+// it come out short. Readings taken with a wrap pending are counted in
+// g_xb_prof_pend_reads and per frame in the history, so xb_prof_dump() shows
+// where times may be short. For long masked or in-handler sections, choose a
+// slower XB_PROF_PRESCALE; XB_MFP_TIMER_DIV_200 gives 50us ticks and a 12.8ms
+// window, longer than a frame.
+//
+// With XB_PROF_RASTER defined, zones are also shown on screen: beginning a
+// zone sets palette entry XB_PROF_RASTER_ENTRY (the backdrop, by default) to
+// the zone's color, and ending it restores the color from before. Each zone
+// then shows as a band as tall as the scanlines it took. xb_vbl_wait() shows
+// the entry's own color while waiting, and XB_PROF_RASTER_VBL_COLOR from the
+// moment the wait ends until the first zone begins, so the line where the
+// program saw vertical blank is marked if it happens during display. The
+// raster bars do not need XB_PROF, and cost a few dozen cycles per zone.
+//
+// By default Timer D is used, which Human68k uses for background processing.
+// Its interrupt handler is replaced until xb_prof_shutdown(). Timer C may be
+// chosen with XB_PROF_TIMER (taking over the cursor and FDD handling), or
+// Timer A if the OPM queue is not in use. Timer B clocks the keyboard.
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include "xbase/memmap.h"
+#include "xbase/mfp.h"
+#include "xbase/pal.h"
+#include "xbase/vidcon.h"
+#endif
+
+#ifndef XB_PROF_TIMER
+#define XB_PROF_TIMER XB_MFP_TIMER_D
+#endif
+
+#ifndef XB_PROF_PRESCALE
+#define XB_PROF_PRESCALE XB_MFP_TIMER_DIV_4
+#endif
+
+#ifndef XB_PROF_ZONES
+#define XB_PROF_ZONES 8
+#endif
+
+#ifndef XB_PROF_HISTORY
+#define XB_PROF_HISTORY 256
+#endif
+
+// Palette entry for the raster bars, as an index into g_xb_pal_buffer.
+#ifndef XB_PROF_RASTER_ENTRY
+#define XB_PROF_RASTER_ENTRY 0
+#endif
+#define XB_PROF_RASTER_ADDR (XB_VIDCON_GP_PAL_BASE + (XB_PROF_RASTER_ENTRY * 2))
+
+#ifndef XB_PROF_RASTER_VBL_COLOR
+#define XB_PROF_RASTER_VBL_COLOR XB_PAL_RGB5(31, 31, 31)
+#endif
+
+#if XB_PROF_TIMER == XB_MFP_TIMER_A
+#define XB_PROF_DATA_REG XB_MFP_TADR
+#define XB_PROF_PEND_REG XB_MFP_IPRA
+#define XB_PROF_PEND_MASK XB_MFP_MASK_TIMER_A
+#define XB_PROF_VECTOR XB_MFP_INT_TIMER_A
+#elif XB_PROF_TIMER == XB_MFP_TIMER_C
+#define XB_PROF_DATA_REG XB_MFP_TCDR
+#define XB_PROF_PEND_REG XB_MFP_IPRB
+#define XB_PROF_PEND_MASK XB_MFP_MASK_TIMER_C
+#define XB_PROF_VECTOR XB_MFP_INT_TIMER_C
+#elif XB_PROF_TIMER == XB_MFP_TIMER_D
+#define XB_PROF_DATA_REG XB_MFP_TDDR
+#define XB_PROF_PEND_REG XB_MFP_IPRB
+#define XB_PROF_PEND_MASK XB_MFP_MASK_TIMER_D
+#define XB_PROF_VECTOR XB_MFP_INT_TIMER_D
+#else
+#error "XB_PROF_TIMER must be Timer A, C or D"
+#endif
+
+#if XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_4
+#define XB_PROF_TICK_NS 1000
+#elif XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_10
+#define XB_PROF_TICK_NS 2500
+#elif XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_16
+#define XB_PROF_TICK_NS 4000
+#elif XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_50
+#define XB_PROF_TICK_NS 12500
+#elif XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_64
+#define XB_PROF_TICK_NS 16000
+#elif XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_100
+#define XB_PROF_TICK_NS 25000
+#elif XB_PROF_PRESCALE == XB_MFP_TIMER_DIV_200
+#define XB_PROF_TICK_NS 50000
+#else
+#error "XB_PROF_PRESCALE must be one of XB_MFP_TIMER_DIV_*"
+#endif
+
+#if defined(XB_PROF) || defined(XB_PROF_RASTER)
+#define XB_PROF_BEGIN(zone) xb_prof_begin(zone)
+#define XB_PROF_END(zone) xb_prof_end(zone)
+#else
+#define XB_PROF_BEGIN(zone) do {} while (0)
+#define XB_PROF_END(zone) do {} while (0)
+#endif  // XB_PROF || XB_PROF_RASTER
+
+#ifdef XB_PROF
+#define XB_PROF_FRAME() xb_prof_frame()
+#else
+#define XB_PROF_FRAME() do {} while (0)
+#endif  // XB_PROF
+
+#ifdef __ASSEMBLER__
+#ifdef XB_PROF
+	.global	g_xb_prof_wraps
+	.global	g_xb_prof_pend_reads
+	.global	g_xb_prof_zone_start
+	.global	g_xb_prof_zone_ticks
+	.global	xb_prof_init
+	.global	xb_prof_shutdown
+	.global	xb_prof_set_name
+	.global	xb_prof_frame
+	.global	xb_prof_dump
+#endif  // XB_PROF
+#ifdef XB_PROF_RASTER
+	.global	g_xb_prof_raster_color
+	.global	g_xb_prof_raster_prev
+	.global	g_xb_prof_raster_colors
+	.global	g_xb_prof_raster_defaults
+	.global	xb_prof_set_color
+#endif  // XB_PROF_RASTER
+#else
+
+#ifdef XB_PROF
+// Timer wraps, incremented by the interrupt.
+extern volatile uint32_t g_xb_prof_wraps;
+// Readings that found a wrap pending, and so may have missed more than one.
+extern volatile uint32_t g_xb_prof_pend_reads;
+// Time each zone was begun, and its total so far this frame.
+extern uint32_t g_xb_prof_zone_start[XB_PROF_ZONES];
+extern uint32_t g_xb_prof_zone_ticks[XB_PROF_ZONES];
+
+// Saves the timer's setting, starts it and installs its interrupt handler, and
+// clears the history. Returns the previous handler.
+void *xb_prof_init(void);
+
+// Restores the previous handler, and the timer's prescale and count as they
+// were before xb_prof_init().
+void xb_prof_shutdown(void);
+
+// Names a zone for xb_prof_dump(). The string is not copied.
+void xb_prof_set_name(uint16_t zone, const char *name);
+
+// Stores the zone totals for the frame in the history, and clears them. Call
+// once per frame, at the same point each time (e.g. after xb_vbl_wait()).
+void xb_prof_frame(void);
+
+// Writes min / avg / max per zone over the frames in the history to a file,
+// followed by the history itself, one frame per line. The last column of each
+// frame is the number of readings that found a wrap pending (see above).
+// Returns false if the file could not be written.
+bool xb_prof_dump(const char *path);
+
+// Current time in ticks.
+static inline uint32_t xb_prof_now(void);
+#endif  // XB_PROF
+
+#ifdef XB_PROF_RASTER
+// Color currently shown, the color each zone replaced, and zone colors.
+extern uint16_t g_xb_prof_raster_color;
+extern uint16_t g_xb_prof_raster_prev[XB_PROF_ZONES];
+extern uint16_t g_xb_prof_raster_colors[XB_PROF_ZONES];
+
+// Default zone colors, used for zones whose color is 0.
+extern const uint16_t g_xb_prof_raster_defaults[8];
+
+// Sets the color a zone is shown in, or 0 for one of a set of eight defaults.
+void xb_prof_set_color(uint16_t zone, uint16_t color);
+#endif  // XB_PROF_RASTER
+
+#if defined(XB_PROF) || defined(XB_PROF_RASTER)
+static inline void xb_prof_begin(uint16_t zone);
+static inline void xb_prof_end(uint16_t zone);
+#endif  // XB_PROF || XB_PROF_RASTER
+
+//
+// Static implementations
+//
+
+#ifdef XB_PROF
+static inline uint32_t xb_prof_now(void)
+{
+	volatile const uint8_t *pend = (volatile const uint8_t *)XB_PROF_PEND_REG;
+	volatile const uint8_t *data = (volatile const uint8_t *)XB_PROF_DATA_REG;
+	uint32_t wraps;
+	uint8_t pend_before, pend_after, count;
+	// A wrap whose interrupt has not been taken yet (e.g. with the IPL raised)
+	// shows as pending; retry if one happens partway through. Only one wrap
+	// can be seen that way, so if the interrupt has been held off for longer
+	// than 256 ticks this reading is short; such readings are counted.
+	do
+	{
+		wraps = g_xb_prof_wraps;
+		pend_before = *pend & XB_PROF_PEND_MASK;
+		count = *data;
+		pend_after = *pend & XB_PROF_PEND_MASK;
+	} while (pend_before != pend_after || wraps != g_xb_prof_wraps);
+	if (pend_after)
+	{
+		wraps++;
+		g_xb_prof_pend_reads++;
+	}
+	// The count runs down from 256 (read as 0).
+	return (wraps << 8) + (uint8_t)(-count);
+}
+#endif  // XB_PROF
+
+#if defined(XB_PROF) || defined(XB_PROF_RASTER)
+static inline void xb_prof_begin(uint16_t zone)
+{
+#ifdef XB_PROF_RASTER
+	g_xb_prof_raster_prev[zone] = g_xb_prof_raster_color;
+	uint16_t color = g_xb_prof_raster_colors[zone];
+	if (color == 0) color = g_xb_prof_raster_defaults[zone & 7];
+	g_xb_prof_raster_color = color;
+	*(volatile uint16_t *)XB_PROF_RASTER_ADDR = color;
+#endif  // XB_PROF_RASTER
+#ifdef XB_PROF
+	g_xb_prof_zone_start[zone] = xb_prof_now();
+#endif  // XB_PROF
+}
+
+static inline void xb_prof_end(uint16_t zone)
+{
+#ifdef XB_PROF
+	g_xb_prof_zone_ticks[zone] += xb_prof_now() - g_xb_prof_zone_start[zone];
+#endif  // XB_PROF
+#ifdef XB_PROF_RASTER
+	g_xb_prof_raster_color = g_xb_prof_raster_prev[zone];
+	*(volatile uint16_t *)XB_PROF_RASTER_ADDR = g_xb_prof_raster_color;
+#endif  // XB_PROF_RASTER
+}
+#endif  // XB_PROF || XB_PROF_RASTER
+
+#endif  // __ASSEMBLER__
@@ -0,0 +1,148 @@
+#pragma once
+// XBase Single Producer / Single Consumer Ring Buffer (ring)
+// (c) Michael Moffitt 2024
+//
+// Passes fixed size elements from one side (e.g. an interrupt handler) to
+// another (e.g. the main loop) without either one raising the IPL or waiting.
+//
+// head is only written by the producer and tail only by the consumer. Each is
+// a free running count, updated with a single word write once the element has
+// been written or read, so the other side always sees either the old or the
+// new value and never a partial element. The number of slots must be a power
+// of two, up to 32768.
+//
+// Only one producer and one consumer may use a ring. Interrupt handlers at
+// different levels can preempt one another, so each should have its own ring
+// rather than share one.
+//
+// Elements may be copied in and out with xb_ring_push() / xb_ring_pop(), or
+// written and read in place:
+//
+//   MyEvent *e = xb_ring_write_ptr(&ring);
+//   if (e)
+//   {
+//       e->type = ...;
+//       xb_ring_write_done(&ring);
+//   }
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "xbase/macro.h"
+#endif
+
+#ifdef __ASSEMBLER__
+	.struct 0
+XBRing.head:	ds.w 1
+XBRing.tail:	ds.w 1
+XBRing.mask:	ds.w 1
+XBRing.size:	ds.w 1
+XBRing.buf:	ds.l 1
+XBRing.len:
+#else
+
+typedef struct XBRing
+{
+	volatile uint16_t head;  // Elements written; only the producer changes it.
+	volatile uint16_t tail;  // Elements read; only the consumer changes it.
+	uint16_t mask;           // Slots - 1.
+	uint16_t size;           // Bytes per element.
+	uint8_t *buf;
+} XBRing;
+
+// Sets up a ring over buf, which holds slots (a power of two) elements of
+// size bytes each. Must not be called while either side is using the ring.
+static inline void xb_ring_init(XBRing *r, void *buf, uint16_t slots,
+                                uint16_t size);
+
+// Elements waiting to be read.
+static inline uint16_t xb_ring_count(const XBRing *r);
+
+//
+// Producer
+//
+
+// Returns the slot for the next element, or NULL if the ring is full.
+static inline void *xb_ring_write_ptr(XBRing *r);
+// Publishes the element written to the slot from xb_ring_write_ptr().
+static inline void xb_ring_write_done(XBRing *r);
+// Copies an element in. Returns false if the ring was full.
+static inline bool xb_ring_push(XBRing *r, const void *data);
+
+//
+// Consumer
+//
+
+// Returns the oldest element, or NULL if the ring is empty.
+static inline const void *xb_ring_read_ptr(XBRing *r);
+// Frees the slot from xb_ring_read_ptr().
+static inline void xb_ring_read_done(XBRing *r);
+// Copies an element out. Returns false if the ring was empty.
+static inline bool xb_ring_pop(XBRing *r, void *out);
+
+//
+// Static implementations
+//
+
+static inline void xb_ring_init(XBRing *r, void *buf, uint16_t slots,
+                                uint16_t size)
+{
+	r->head = 0;
+	r->tail = 0;
+	r->mask = slots - 1;
+	r->size = size;
+	r->buf = (uint8_t *)buf;
+}
+
+static inline uint16_t xb_ring_count(const XBRing *r)
+{
+	return (uint16_t)(r->head - r->tail);
+}
+
+static inline void *xb_ring_write_ptr(XBRing *r)
+{
+	const uint16_t head = r->head;
+	if ((uint16_t)(head - r->tail) > r->mask) return NULL;
+	return r->buf + ((head & r->mask) * r->size);
+}
+
+static inline void xb_ring_write_done(XBRing *r)
+{
+	XB_BARRIER();  // The element is written before it is published.
+	r->head = r->head + 1;
+}
+
+static inline bool xb_ring_push(XBRing *r, const void *data)
+{
+	void *slot = xb_ring_write_ptr(r);
+	if (!slot) return false;
+	memcpy(slot, data, r->size);
+	xb_ring_write_done(r);
+	return true;
+}
+
+static inline const void *xb_ring_read_ptr(XBRing *r)
+{
+	const uint16_t tail = r->tail;
+	if (tail == r->head) return NULL;
+	XB_BARRIER();  // The element is read after head says it is there.
+	return r->buf + ((tail & r->mask) * r->size);
+}
+
+static inline void xb_ring_read_done(XBRing *r)
+{
+	XB_BARRIER();  // The element is read before its slot is freed.
+	r->tail = r->tail + 1;
+}
+
+static inline bool xb_ring_pop(XBRing *r, void *out)
+{
+	const void *slot = xb_ring_read_ptr(r);
+	if (!slot) return false;
+	memcpy(out, slot, r->size);
+	xb_ring_read_done(r);
+	return true;
+}
+
+#endif  // __ASSEMBLER__
@@ -0,0 +1,47 @@
+#include "xbase/util/vbl_wait.h"
+
+#include "xbase/ipl.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+XBVblCommit g_xb_vbl_commits[XB_VBL_COMMIT_COUNT + 1];
+
+bool xb_vbl_add_commit(void (*func)(void), uint16_t prio, uint16_t flags)
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	uint16_t count = 0;
+	while (g_xb_vbl_commits[count].func) count++;
+	if (count >= XB_VBL_COMMIT_COUNT)
+	{
+		xb_set_ipl(ipl);
+		return false;
+	}
+
+	// Insert after any of equal or lower priority.
+	uint16_t i = count;
+	while (i > 0 && g_xb_vbl_commits[i - 1].prio > prio)
+	{
+		g_xb_vbl_commits[i] = g_xb_vbl_commits[i - 1];
+		i--;
+	}
+	g_xb_vbl_commits[i].func = func;
+	g_xb_vbl_commits[i].prio = prio;
+	g_xb_vbl_commits[i].flags = flags;
+	g_xb_vbl_commits[count + 1].func = NULL;
+	xb_set_ipl(ipl);
+	return true;
+}
+
+void xb_vbl_remove_commit(void (*func)(void))
+{
+	const uint8_t ipl = xb_set_ipl(XB_IPL_ALLOW_NONE);
+	uint16_t out = 0;
+	for (uint16_t i = 0; g_xb_vbl_commits[i].func; i++)
+	{
+		if (g_xb_vbl_commits[i].func == func) continue;
+		g_xb_vbl_commits[out++] = g_xb_vbl_commits[i];
+	}
+	g_xb_vbl_commits[out].func = NULL;
+	xb_set_ipl(ipl);
+}
@@ -1,12 +1,88 @@
 #pragma once
+// Vertical blank waiting and commit hooks.
+//
+// Modules that send buffered state to the hardware (palette, scroll,
+// sprites, OPM registers) can register commit functions with
+// xb_vbl_add_commit(). The vblank interrupt runs them in priority order
+// (lowest first) at the top of the blanking interval, instead of the main
+// loop running them whenever it wakes up.
+//
+// Commits are normally only run once the main loop has finished a frame and
+// called xb_vbl_frame_ready(); a frame that is not finished in time leaves
+// the previous state on screen, untouched, and is counted as missed. After
+// calling xb_vbl_frame_ready(), the main loop must not change the buffered
+// state until the commits have run (xb_vbl_wait() returns after they have).
+// Commits registered with XB_VBL_COMMIT_ALWAYS run on every vblank.
+//
+//   xb_vbl_add_commit(xb_crtc_set_scroll, XB_VBL_PRIO_SCROLL, 0);
+//   xb_vbl_add_commit(xb_pcg_finish_sprites, XB_VBL_PRIO_SPRITES, 0);
+//   xb_vbl_add_commit(xb_pal_commit, XB_VBL_PRIO_PAL, 0);
+//   while (running)
+//   {
+//       game_update();
+//       game_render();
+//       xb_vbl_frame_ready();
+//       xb_vbl_wait();
+//   }
+//
+// Commit functions are regular C functions, run from the interrupt.
+
+// Maximum number of commit functions.
+#define XB_VBL_COMMIT_COUNT 8
+
+// Flags for xb_vbl_add_commit().
+#define XB_VBL_COMMIT_ALWAYS 0x0001  // Run even if no frame is ready.
+
+// Suggested priorities. Input is sampled first (see util/insample), at a
+// fixed point in the frame, then whatever changes the picture goes next, so it
+// is done before the display starts.
+#define XB_VBL_PRIO_INPUT   0
+#define XB_VBL_PRIO_DISPLAY 5
+#define XB_VBL_PRIO_SCROLL  10
+#define XB_VBL_PRIO_SPRITES 20
+#define XB_VBL_PRIO_PAL     30
+#define XB_VBL_PRIO_OPM     40
+
+// XB_VBL_PRIO_OPM is for an xb_opm_commit() hook. The OPM takes each write as
+// an address write followed by a data write; xb_opm_write() (and the key on,
+// LFO and noise helpers built on it) masks interrupts between the two, as
+// does the OPM queue (XB_OPM_QUEUE), so the main loop may keep using them.
+// The main loop must not call xb_opm_commit() itself, which is not masked and
+// shares the register cache with the hook.
 
 #ifdef __ASSEMBLER__
+	.struct 0
+XBVblCommit.func:	ds.l 1
+XBVblCommit.prio:	ds.w 1
+XBVblCommit.flags:	ds.w 1
+XBVblCommit.len:
+
+	.global	g_xb_vbl_commits
+	.global	g_xb_vbl_frame_ready
 	.global	xb_vbl_wait_init
 	.global	xb_vbl_wait
 	.global	xb_vbl_get_frame_count
+	.global	xb_vbl_get_missed_count
+	.global	xb_vbl_set_hook
+	.global	xb_vbl_add_commit
+	.global	xb_vbl_remove_commit
 #else
 
+#include <stdbool.h>
 #include <stdint.h>
+#include "xbase/macro.h"
+
+typedef struct XBVblCommit
+{
+	void (*func)(void);  // NULL ends the list.
+	uint16_t prio;
+	uint16_t flags;
+} XBVblCommit;
+
+// Registered commits in priority order, followed by an empty entry.
+extern XBVblCommit g_xb_vbl_commits[XB_VBL_COMMIT_COUNT + 1];
+// Set by xb_vbl_frame_ready(), and cleared once the commits have run.
+extern volatile uint16_t g_xb_vbl_frame_ready;
 
 // Registers a simple interrupt handler for the vertical blank interval.
 // Returns a pointer to the previous routine so it may be saved.
@@ -18,4 +94,30 @@ void xb_vbl_wait(void);
 // Returns the number of frames that have elapsed since xb_vbl_wait_init().
 uint32_t xb_vbl_get_frame_count(void);
 
+// Returns the number of vblanks that found no frame ready while there were
+// commits waiting for one.
+uint32_t xb_vbl_get_missed_count(void);
+
+// Sets a function to be called from the vertical blank interrupt, after the
+// frame count is updated and the commits have run. The hook is a regular C
+// function, not an ISR.
+// Pass NULL to remove it.
+// Returns the previous hook.
+void *xb_vbl_set_hook(void (*hook)(void));
+
+// Registers a commit function (see above). flags is 0 or
+// XB_VBL_COMMIT_ALWAYS. Functions of equal priority run in the order added.
+// Returns false if XB_VBL_COMMIT_COUNT are already registered.
+bool xb_vbl_add_commit(void (*func)(void), uint16_t prio, uint16_t flags);
+
+// Removes a commit function.
+void xb_vbl_remove_commit(void (*func)(void));
+
+// Marks the buffered state as complete, to be committed at the next vblank.
+static inline void xb_vbl_frame_ready(void)
+{
+	XB_BARRIER();  // The state is written before it is marked ready.
+	g_xb_vbl_frame_ready = 1;
+}
+
 #endif
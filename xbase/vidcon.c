@@ -1,12 +1,52 @@
 #include "xbase/vidcon.h"
 
+XBVidconCfg g_xb_vidcon_shadow;
+uint16_t g_xb_vidcon_dirty;
+
 void xb_vidcon_init(const XBVidconCfg *c)
 {
 	volatile uint16_t *r0 = (volatile uint16_t *)XB_VIDCON_R0;
 	volatile uint16_t *r1 = (volatile uint16_t *)XB_VIDCON_R1;
 	volatile uint16_t *r2 = (volatile uint16_t *)XB_VIDCON_R2;
 
+	g_xb_vidcon_shadow = *c;
+	g_xb_vidcon_dirty = 0;
+
 	*r0 = c->screen;
 	*r1 = c->prio;
 	*r2 = c->flags;
 }
+
+void xb_vidcon_init_default(void)
+{
+	static const XBVidconCfg default_cfg =
+	{
+		XB_VIDCON_SCREEN_16C,
+		0x12E4,
+		XB_VIDCON_LAYER_MASK
+	};
+	xb_vidcon_init(&default_cfg);
+}
+
+void xb_vidcon_commit_regs(void)
+{
+	const uint16_t dirty = g_xb_vidcon_dirty;
+	if (!dirty) return;
+	g_xb_vidcon_dirty = 0;
+
+	if (dirty & XB_VIDCON_DIRTY_SCREEN)
+	{
+		volatile uint16_t *r0 = (volatile uint16_t *)XB_VIDCON_R0;
+		*r0 = g_xb_vidcon_shadow.screen;
+	}
+	if (dirty & XB_VIDCON_DIRTY_PRIO)
+	{
+		volatile uint16_t *r1 = (volatile uint16_t *)XB_VIDCON_R1;
+		*r1 = g_xb_vidcon_shadow.prio;
+	}
+	if (dirty & XB_VIDCON_DIRTY_FLAGS)
+	{
+		volatile uint16_t *r2 = (volatile uint16_t *)XB_VIDCON_R2;
+		*r2 = g_xb_vidcon_shadow.flags;
+	}
+}
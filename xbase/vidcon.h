@@ -3,15 +3,17 @@
 //
 // Provides some helper functions for configuring the video controller. The
 // configuration is stored in three words of shadow copies of the registers,
-// which are initially set with xb_vidcon_init_default().
+// which are initially set with xb_vidcon_init() or xb_vidcon_init_default().
 //
 // Afterwards, individual bits may be set or cleared with the clearly named
 // helper functions. These functions modify the shadow copies. To write the shadow
 // copies to the actual hardware registers, call xb_vidcon_commit_regs(). Ideally,
-// the register commit occurs during video blank.
+// the register commit occurs during video blank. Only registers that were
+// changed since the last commit are written.
 #pragma once 
 
 #ifndef __ASSEMBLER__
+#include <stdbool.h>
 #include <stdint.h>
 #include "xbase/memmap.h"
 #endif
@@ -31,7 +33,63 @@ flags = 0x007F;  // Enable all layers.
 
 */
 
-// TODO: Enums for screen, prio, and flag registers.
+// R0: Screen
+#define XB_VIDCON_SCREEN_16C       0x0000
+#define XB_VIDCON_SCREEN_256C      0x0001
+#define XB_VIDCON_SCREEN_65536C    0x0003
+#define XB_VIDCON_SCREEN_1024PX    0x0004
+
+// R1: Priority (shift counts for the two-bit fields)
+#define XB_VIDCON_PRIO_PCG_SHIFT   12
+#define XB_VIDCON_PRIO_TEXT_SHIFT  10
+#define XB_VIDCON_PRIO_GP_SHIFT    8
+#define XB_VIDCON_PRIO_GP3_SHIFT   6
+#define XB_VIDCON_PRIO_GP2_SHIFT   4
+#define XB_VIDCON_PRIO_GP1_SHIFT   2
+#define XB_VIDCON_PRIO_GP0_SHIFT   0
+
+// R2: Flags
+#define XB_VIDCON_FLAG_YS          0x8000
+#define XB_VIDCON_FLAG_AH          0x4000
+#define XB_VIDCON_FLAG_VHT         0x2000
+#define XB_VIDCON_FLAG_EXON        0x1000
+#define XB_VIDCON_FLAG_HP          0x0800
+#define XB_VIDCON_FLAG_BP          0x0400
+#define XB_VIDCON_FLAG_GG          0x0200
+#define XB_VIDCON_FLAG_GT          0x0100
+#define XB_VIDCON_FLAG_BORDER      0x0080
+#define XB_VIDCON_FLAG_PCG_EN      0x0040
+#define XB_VIDCON_FLAG_TEXT_EN     0x0020
+#define XB_VIDCON_FLAG_GP_EN       0x0010
+#define XB_VIDCON_FLAG_GP3_EN      0x0008
+#define XB_VIDCON_FLAG_GP2_EN      0x0004
+#define XB_VIDCON_FLAG_GP1_EN      0x0002
+#define XB_VIDCON_FLAG_GP0_EN      0x0001
+
+// Layer enable bits, for xb_vidcon_set_layers().
+#define XB_VIDCON_LAYER_MASK       0x007F
+// Special priority / translucency bits, for xb_vidcon_set_effect().
+#define XB_VIDCON_EFFECT_MASK      0x5F00
+
+// Effect presets for xb_vidcon_set_effect().
+// No special priority or translucency.
+#define XB_VIDCON_EFFECT_NONE        0x0000
+// Text/PCG is mixed 50% with the layer below it.
+#define XB_VIDCON_EFFECT_HALF_TEXT   (XB_VIDCON_FLAG_EXON | XB_VIDCON_FLAG_HP | \
+                                      XB_VIDCON_FLAG_GT)
+// The graphics screen is mixed 50% with the layer below it.
+#define XB_VIDCON_EFFECT_HALF_GP     (XB_VIDCON_FLAG_EXON | XB_VIDCON_FLAG_HP | \
+                                      XB_VIDCON_FLAG_GG)
+// Both of the above.
+#define XB_VIDCON_EFFECT_HALF_ALL    (XB_VIDCON_EFFECT_HALF_TEXT | \
+                                      XB_VIDCON_EFFECT_HALF_GP)
+// Graphics pixels with the special priority bit set are drawn on top.
+#define XB_VIDCON_EFFECT_SPECIAL_PRIO (XB_VIDCON_FLAG_EXON)
+
+// Dirty flags for the shadow registers.
+#define XB_VIDCON_DIRTY_SCREEN 0x0001
+#define XB_VIDCON_DIRTY_PRIO   0x0002
+#define XB_VIDCON_DIRTY_FLAGS  0x0004
 
 #ifdef __ASSEMBLER__
 	.struct 0
@@ -86,9 +144,97 @@ typedef struct XBVidconCfg
 
 #ifdef __ASSEMBLER__
 	.global	xb_vidcon_init
+	.global	xb_vidcon_init_default
+	.global	xb_vidcon_commit_regs
+
+	.extern	g_xb_vidcon_shadow
+	.extern	g_xb_vidcon_dirty
 #else
+
+extern XBVidconCfg g_xb_vidcon_shadow;
+extern uint16_t g_xb_vidcon_dirty;
+
+// Sets the shadow registers and writes them to the video controller at once.
 void xb_vidcon_init(const XBVidconCfg *c);
 
+// Initializes with the example configuration above.
+void xb_vidcon_init_default(void);
+
+// Writes shadow registers that have changed since the last commit to the
+// video controller. Call during vblank.
+void xb_vidcon_commit_regs(void);
+
+// Shadow register setters. Changes take effect on xb_vidcon_commit_regs().
+static inline void xb_vidcon_set_screen(uint16_t screen);
+static inline void xb_vidcon_set_prio(uint16_t prio);
+static inline void xb_vidcon_set_flags(uint16_t flags);
+
+// Enables (en = true) or disables the layers in mask (XB_VIDCON_FLAG_*_EN).
+static inline void xb_vidcon_set_layers(uint16_t mask, bool en);
+
+// Sets one of the two-bit priority fields (0 = top, 3 = bottom).
+// shift: XB_VIDCON_PRIO_*_SHIFT
+static inline void xb_vidcon_set_layer_prio(uint16_t shift, uint16_t prio);
+
+// Replaces the special priority / translucency bits with an effect preset
+// (XB_VIDCON_EFFECT_*), or any combination of bits from XB_VIDCON_EFFECT_MASK.
+static inline void xb_vidcon_set_effect(uint16_t effect);
+
+// Enables the border color display.
+static inline void xb_vidcon_set_border(bool en);
+
+//
+// Static implementations
+//
+
+static inline void xb_vidcon_set_screen(uint16_t screen)
+{
+	if (g_xb_vidcon_shadow.screen == screen) return;
+	g_xb_vidcon_shadow.screen = screen;
+	g_xb_vidcon_dirty |= XB_VIDCON_DIRTY_SCREEN;
+}
+
+static inline void xb_vidcon_set_prio(uint16_t prio)
+{
+	if (g_xb_vidcon_shadow.prio == prio) return;
+	g_xb_vidcon_shadow.prio = prio;
+	g_xb_vidcon_dirty |= XB_VIDCON_DIRTY_PRIO;
+}
+
+static inline void xb_vidcon_set_flags(uint16_t flags)
+{
+	if (g_xb_vidcon_shadow.flags == flags) return;
+	g_xb_vidcon_shadow.flags = flags;
+	g_xb_vidcon_dirty |= XB_VIDCON_DIRTY_FLAGS;
+}
+
+static inline void xb_vidcon_set_layers(uint16_t mask, bool en)
+{
+	mask &= XB_VIDCON_LAYER_MASK;
+	if (en) xb_vidcon_set_flags(g_xb_vidcon_shadow.flags | mask);
+	else xb_vidcon_set_flags(g_xb_vidcon_shadow.flags & ~mask);
+}
+
+static inline void xb_vidcon_set_layer_prio(uint16_t shift, uint16_t prio)
+{
+	uint16_t v = g_xb_vidcon_shadow.prio & ~(0x0003 << shift);
+	v |= (prio & 0x0003) << shift;
+	xb_vidcon_set_prio(v);
+}
+
+static inline void xb_vidcon_set_effect(uint16_t effect)
+{
+	uint16_t v = g_xb_vidcon_shadow.flags & ~XB_VIDCON_EFFECT_MASK;
+	v |= effect & XB_VIDCON_EFFECT_MASK;
+	xb_vidcon_set_flags(v);
+}
+
+static inline void xb_vidcon_set_border(bool en)
+{
+	if (en) xb_vidcon_set_flags(g_xb_vidcon_shadow.flags | XB_VIDCON_FLAG_BORDER);
+	else xb_vidcon_set_flags(g_xb_vidcon_shadow.flags & ~XB_VIDCON_FLAG_BORDER);
+}
+
 // Graphics plane palette entries
 static inline void xb_vidcon_set_gp_color(uint16_t index, uint16_t val)
 {
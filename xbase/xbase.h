@@ -3,17 +3,31 @@
 #include "xbase/memmap.h"
 #include "xbase/macro.h"
 
+#include "xbase/adpcm.h"
 #include "xbase/crtc.h"
 #include "xbase/ipl.h"
 #include "xbase/joy.h"
 #include "xbase/keys.h"
 #include "xbase/mfp.h"
 #include "xbase/opm.h"
+#include "xbase/opm_queue.h"
 #include "xbase/pal.h"
 #include "xbase/pcg.h"
 #include "xbase/vidcon.h"
 
 #include "xbase/util/crtcgen.h"
+#include "xbase/util/defer.h"
 #include "xbase/util/display.h"
 #include "xbase/util/fixed.h"
+#include "xbase/util/frame.h"
+#include "xbase/util/insample.h"
+#include "xbase/util/irqlat.h"
+#include "xbase/util/opmpitch.h"
+#include "xbase/util/opmseq.h"
+#include "xbase/util/opmstream.h"
+#include "xbase/util/opmvoice.h"
+#include "xbase/util/palcycle.h"
+#include "xbase/util/palfx.h"
+#include "xbase/util/prof.h"
+#include "xbase/util/ring.h"
 #include "xbase/util/vbl_wait.h"